@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+
+# Measure the USB MIDI latency to a neosam device with the ping SysEx
+# (MF_SYSEX_PARAM_PING in src/include/midi/sysex.h).
+#
+# Each ping carries a nonce, the device echoes it with the time it read the
+# ping and the time it queued the reply (16 us units). The round trip minus
+# the time spent in the device is split evenly for the one-way estimate, and
+# the spread of each direction is shown against the fastest ping, so an
+# uneven host or hub shows up on one side.
+#
+# Time waiting in the device transmit ring counts towards the return leg. The
+# spread of each direction drifts slowly with the device clock, keep runs to
+# a minute or so.
+#
+# Needs python-rtmidi (pip install python-rtmidi).
+# Example: ./sysex_ping.py --count 500 --interval 0.02
+
+import argparse
+import statistics
+import sys
+import threading
+import time
+
+import rtmidi
+
+MFR_ID = [0x53, 0x41, 0x4D]
+CMD_GET = 0
+CMD_GET_RESPONSE = 1
+PARAM_PING = 23
+
+TICK_US = 16
+TICK_MASK = (1 << 21) - 1
+
+
+def find_port(ports, name):
+    for i, p in enumerate(ports.get_ports()):
+        if name.lower() in p.lower():
+            return i
+    sys.exit("No MIDI port matching '%s' (found: %s)" %
+             (name, ", ".join(ports.get_ports()) or "none"))
+
+
+def get_u21(b):
+    return (b[0] << 14) | (b[1] << 7) | b[2]
+
+
+def summary(name, values):
+    v = sorted(values)
+    p95 = v[min(len(v) - 1, (len(v) * 95) // 100)]
+    print("%-12s min %8.3f  median %8.3f  p95 %8.3f  max %8.3f ms" %
+          (name, v[0] / 1000, statistics.median(v) / 1000, p95 / 1000,
+           v[-1] / 1000))
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="USB MIDI round trip to a neosam device")
+    ap.add_argument("--port", default="SAMURAI",
+                    help="part of the MIDI port name (default SAMURAI)")
+    ap.add_argument("--count", type=int, default=100)
+    ap.add_argument("--interval", type=float, default=0.05,
+                    help="seconds between pings")
+    ap.add_argument("--timeout", type=float, default=0.5,
+                    help="seconds to wait for each reply")
+    ap.add_argument("--verbose", action="store_true",
+                    help="print every ping")
+    args = ap.parse_args()
+
+    midi_in = rtmidi.MidiIn()
+    midi_out = rtmidi.MidiOut()
+    midi_in.ignore_types(sysex=False, timing=True, active_sense=True)
+    midi_in.open_port(find_port(midi_in, args.port))
+    midi_out.open_port(find_port(midi_out, args.port))
+
+    reply = {}
+    got = threading.Event()
+
+    # Timestamp replies as they arrive rather than when the loop wakes up
+    def on_message(event, _):
+        now = time.perf_counter_ns() // 1000
+        msg = event[0]
+        if (len(msg) >= 7 and msg[0] == 0xF0 and msg[1:4] == MFR_ID and
+                msg[4] == CMD_GET_RESPONSE and msg[5] == PARAM_PING):
+            reply["msg"] = msg
+            reply["us"] = now
+            got.set()
+
+    midi_in.set_callback(on_message)
+
+    rtt, turn, oneway, up, down = [], [], [], [], []
+    dev_prev = None
+    dev_base = 0
+    lost = 0
+
+    for seq in range(args.count):
+        nonce = seq & 0x3FFF
+        got.clear()
+        reply.clear()
+
+        t_send = time.perf_counter_ns() // 1000
+        midi_out.send_message([0xF0] + MFR_ID +
+                              [CMD_GET, PARAM_PING, nonce >> 7, nonce & 0x7F,
+                               0xF7])
+
+        if not got.wait(args.timeout):
+            lost += 1
+            continue
+
+        msg, t_recv = reply["msg"], reply["us"]
+        if msg[6] != 8:
+            sys.exit("Device does not support ping (error %d)" % msg[7])
+        if ((msg[7] << 7) | msg[8]) != nonce:
+            lost += 1
+            continue
+
+        dev_rx = get_u21(msg[9:12])
+        dev_tx = get_u21(msg[12:15])
+
+        # Unwrap the device clock so both legs can be compared between pings
+        if dev_prev is not None:
+            dev_base += (dev_rx - dev_prev) & TICK_MASK
+        dev_prev = dev_rx
+        rx_us = dev_base * TICK_US
+        tx_us = rx_us + ((dev_tx - dev_rx) & TICK_MASK) * TICK_US
+
+        r = t_recv - t_send
+        d = tx_us - rx_us
+        rtt.append(r)
+        turn.append(d)
+        oneway.append((r - d) / 2)
+        up.append(rx_us - t_send)  # Both include the unknown clock offset
+        down.append(t_recv - tx_us)
+
+        if args.verbose:
+            print("%5d  rtt %8.3f  device %7.3f  one-way %8.3f ms" %
+                  (seq, r / 1000, d / 1000, (r - d) / 2000))
+
+        time.sleep(args.interval)
+
+    if not rtt:
+        sys.exit("No replies (%d lost)" % lost)
+
+    print("%d replies, %d lost" % (len(rtt), lost))
+    summary("round trip", rtt)
+    summary("in device", turn)
+    summary("one-way", oneway)
+    # Spread over the fastest ping in each direction
+    summary("to device+", [u - min(up) for u in up])
+    summary("from device+", [d - min(down) for d in down])
+
+
+if __name__ == "__main__":
+    main()
@@ -14,10 +14,12 @@
 #include "system/error.h"
 #include "system/hardware.h"
 #include "system/time.h"
+#include "virtmap/index.h"
+#include "virtmap/pool.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-#define EE_VERSION (u16)(11)
+#define EE_VERSION (u16)(16)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -31,6 +33,7 @@ struct eeprom_midi_cfg {
 		u8 cc;
 		u8 raw;
 	};
+	u8 param_msb;
 };
 
 typedef union {
@@ -50,6 +53,20 @@ struct eeprom_virtmap_cfg {
 	} position;
 };
 
+struct eeprom_vmap {
+	eeprom_proto_cfg_s cfg;
+	u8								 hires;
+	u8								 curve;
+	u8								 rgb_r;
+	u8								 rgb_g;
+	u8								 rgb_b;
+	uint16_t					 hsv_h; // Hue (0-1535)
+	u8								 hsv_s; // Saturation (0-255)
+	u8								 hsv_v; // Value (0-255)
+	u8								 rb_r;
+	u8								 rb_b;
+};
+
 struct eeprom_encoder {
 	// General
 	u8 display_mode : 2;
@@ -58,29 +75,21 @@ struct eeprom_encoder {
 	// Encoder
 	u8 detent				: 1;
 	u8 vmap_mode		: 1;
-	u8 vmap_active	: 1;
+	u8 vmap_active	: 3;
+	u8 vmap_count;
+	u8 accel_profile;
 
 	// Encoder Switch
 	u8								 sw_mode;
 	eeprom_proto_cfg_s sw_cfg;
-
-	struct {
-		eeprom_proto_cfg_s cfg;
-		u8								 rgb_r;
-		u8								 rgb_g;
-		u8								 rgb_b;
-		uint16_t					 hsv_h; // Hue (0-1535)
-		u8								 hsv_s; // Saturation (0-255)
-		u8								 hsv_v; // Value (0-255)
-		u8								 rb_r;
-		u8								 rb_b;
-	} vmap[NUM_VMAPS_PER_ENC];
 };
 
 struct eeprom {
 	u16										version;
 	u8										reset_pending; // Flag to indicate pending config reset
 	struct eeprom_encoder encoders[NUM_ENC_BANKS][NUM_ENCODERS];
+	struct eeprom_vmap		vmaps[VMAP_POOL_SIZE]; // In pool order
+	u16 user_curves[VMAP_CURVE_USER_NB][VMAP_CURVE_POINTS];
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -90,8 +99,10 @@ static int encode_encoder(const struct encoder*	 src,
 													struct eeprom_encoder* dst);
 static int decode_encoder(const struct eeprom_encoder* src,
 													struct encoder*							 dst);
-static int decode_proto_cfg(const eeprom_proto_cfg_s* src,
-														struct proto_cfg*					dst);
+static void encode_vmap(const struct virtmap* src, struct eeprom_vmap* dst);
+static void decode_vmap(const struct eeprom_vmap* src, struct virtmap* dst);
+static int	decode_proto_cfg(const eeprom_proto_cfg_s* src,
+														 struct proto_cfg*				 dst);
 static int encode_proto_cfg(const struct proto_cfg* src,
 														eeprom_proto_cfg_s*			dst);
 static int init_eeprom(void);
@@ -141,6 +152,10 @@ int cfg_init(bool reset_cfg) {
 }
 
 int cfg_load(void) {
+	// User curves are shared by all vmaps
+	eeprom_read_block(gVMAP_USER_CURVES, eeprom_data.user_curves,
+										sizeof(gVMAP_USER_CURVES));
+
 	// Load encoder banks
 	for (int i = 0; i < NUM_ENC_BANKS; i++) {
 		for (int j = 0; j < NUM_ENCODERS; j++) {
@@ -151,7 +166,22 @@ int cfg_load(void) {
 		}
 	}
 
-	return SUCCESS;
+	// The vmap counts determine where each encoder's vmaps are in the pool
+	int ret = vmap_pool_layout();
+	if (ret != SUCCESS) {
+		vmap_pool_init();
+	} else {
+		u8 used = VMAP_POOL_SIZE - vmap_pool_free();
+		for (u8 id = 0; id < used; id++) {
+			struct eeprom_vmap ee_vmap = {0};
+			eeprom_read_block(&ee_vmap, &eeprom_data.vmaps[id],
+												sizeof(struct eeprom_vmap));
+			decode_vmap(&ee_vmap, &gVMAP_POOL[id]);
+		}
+	}
+
+	vmap_index_build();
+	return ret;
 }
 
 int cfg_store(void) {
@@ -166,6 +196,16 @@ int cfg_store(void) {
 		}
 	}
 
+	for (u8 id = 0; id < VMAP_POOL_SIZE; id++) {
+		struct eeprom_vmap vmap = {0};
+		encode_vmap(&gVMAP_POOL[id], &vmap);
+		eeprom_update_block(&vmap, &eeprom_data.vmaps[id],
+												sizeof(struct eeprom_vmap));
+	}
+
+	eeprom_update_block(gVMAP_USER_CURVES, eeprom_data.user_curves,
+											sizeof(gVMAP_USER_CURVES));
+
 	return SUCCESS;
 }
 
@@ -200,22 +240,8 @@ static int encode_encoder(const struct encoder*	 src,
 	dst->vmap_mode		= src->vmap_mode;
 	dst->sw_mode			= src->sw_mode;
 	dst->vmap_active	= src->vmap_active;
-
-	for (int i = 0; i < NUM_VMAPS_PER_ENC; i++) {
-		// Save RGB and HSV color values
-		dst->vmap[i].rgb_r = src->vmaps[i].rgb.red;
-		dst->vmap[i].rgb_g = src->vmaps[i].rgb.green;
-		dst->vmap[i].rgb_b = src->vmaps[i].rgb.blue;
-
-		// Add saving of HSV values
-		dst->vmap[i].hsv_h = src->vmaps[i].hsv.hue;
-		dst->vmap[i].hsv_s = src->vmaps[i].hsv.saturation;
-		dst->vmap[i].hsv_v = src->vmaps[i].hsv.value;
-
-		dst->vmap[i].rb_r = src->vmaps[i].rb.red;
-		dst->vmap[i].rb_b = src->vmaps[i].rb.blue;
-		encode_proto_cfg(&src->vmaps[i].cfg, &dst->vmap[i].cfg);
-	}
+	dst->vmap_count		= src->vmap_count;
+	dst->accel_profile = src->enc_ctx.accel_profile;
 
 	encode_proto_cfg(&src->sw_cfg, &dst->sw_cfg);
 
@@ -230,30 +256,52 @@ static int decode_encoder(const struct eeprom_encoder* src,
 	dst->vmap_mode				= src->vmap_mode;
 	dst->sw_mode					= src->sw_mode;
 	dst->vmap_active			= src->vmap_active;
-
-	for (int i = 0; i < NUM_VMAPS_PER_ENC; i++) {
-		// Load RGB values
-		dst->vmaps[i].rgb.red		= src->vmap[i].rgb_r;
-		dst->vmaps[i].rgb.green = src->vmap[i].rgb_g;
-		dst->vmaps[i].rgb.blue	= src->vmap[i].rgb_b;
-
-		// Load HSV values
-		dst->vmaps[i].hsv.hue				 = src->vmap[i].hsv_h;
-		dst->vmaps[i].hsv.saturation = src->vmap[i].hsv_s;
-		dst->vmaps[i].hsv.value			 = src->vmap[i].hsv_v;
-
-		// Update RGB values from HSV values to ensure consistency
-		color_update_vmap_rgb(&dst->vmaps[i]);
-
-		dst->vmaps[i].rb.red	= src->vmap[i].rb_r;
-		dst->vmaps[i].rb.blue = src->vmap[i].rb_b;
-		decode_proto_cfg(&src->vmap[i].cfg, &dst->vmaps[i].cfg);
-	}
+	dst->vmap_count				= src->vmap_count;
+	dst->enc_ctx.accel_profile = src->accel_profile;
 
 	decode_proto_cfg(&src->sw_cfg, &dst->sw_cfg);
 	return SUCCESS;
 }
 
+static void encode_vmap(const struct virtmap* src, struct eeprom_vmap* dst) {
+	// Save RGB and HSV color values
+	dst->rgb_r = src->rgb.red;
+	dst->rgb_g = src->rgb.green;
+	dst->rgb_b = src->rgb.blue;
+
+	dst->hsv_h = src->hsv.hue;
+	dst->hsv_s = src->hsv.saturation;
+	dst->hsv_v = src->hsv.value;
+
+	dst->rb_r	 = src->rb.red;
+	dst->rb_b	 = src->rb.blue;
+	dst->hires = src->hires;
+	dst->curve = src->curve;
+	encode_proto_cfg(&src->cfg, &dst->cfg);
+}
+
+static void decode_vmap(const struct eeprom_vmap* src, struct virtmap* dst) {
+	// Load RGB values
+	dst->rgb.red	 = src->rgb_r;
+	dst->rgb.green = src->rgb_g;
+	dst->rgb.blue	 = src->rgb_b;
+
+	// Load HSV values
+	dst->hsv.hue				= src->hsv_h;
+	dst->hsv.saturation = src->hsv_s;
+	dst->hsv.value			= src->hsv_v;
+
+	// Update RGB values from HSV values to ensure consistency
+	color_update_vmap_rgb(dst);
+
+	dst->rb.red	 = src->rb_r;
+	dst->rb.blue = src->rb_b;
+	dst->hires	 = src->hires;
+	dst->curve	 = src->curve;
+	decode_proto_cfg(&src->cfg, &dst->cfg);
+	vmap_compile(dst);
+}
+
 static int decode_proto_cfg(const eeprom_proto_cfg_s* src,
 														struct proto_cfg*					dst) {
 	switch (src->type) {
@@ -265,9 +313,10 @@ static int decode_proto_cfg(const eeprom_proto_cfg_s* src,
 
 		case PROTOCOL_MIDI:
 			dst->type					= PROTOCOL_MIDI;
-			dst->midi.mode		= src->midi.mode;
-			dst->midi.channel = src->midi.channel;
-			dst->midi.raw			= src->midi.raw;
+			dst->midi.mode			= src->midi.mode;
+			dst->midi.channel		= src->midi.channel;
+			dst->midi.raw				= src->midi.raw;
+			dst->midi.param_msb = src->midi.param_msb;
 			break;
 
 		default: return ERR_UNSUPPORTED;
@@ -286,9 +335,10 @@ static int encode_proto_cfg(const struct proto_cfg* src,
 			break;
 
 		case PROTOCOL_MIDI:
-			dst->midi.mode		= src->midi.mode;
-			dst->midi.channel = src->midi.channel;
-			dst->midi.raw			= src->midi.raw;
+			dst->midi.mode			= src->midi.mode;
+			dst->midi.channel		= src->midi.channel;
+			dst->midi.raw				= src->midi.raw;
+			dst->midi.param_msb = src->midi.param_msb;
 			break;
 
 		default: return ERR_UNSUPPORTED;
@@ -14,6 +14,12 @@
 #include "led/color.h"	// Add color header for HSV functions
 #include "system/rng.h" // Add RNG header for accessing seed value
 #include "system/hardware.h"
+#include "system/latency.h"
+#include "system/time.h"
+#include "midi/midi.h"
+#include "midi/clock.h"
+#include "midi/tx_ring.h"
+#include "virtmap/pool.h"
 #include "usb/usb.h"
 
 #include <LUFA/Drivers/USB/Class/Device/CDCClassDevice.h>
@@ -66,6 +72,11 @@ static void handle_signature(const char* args);
 static void handle_temperature(const char* args);
 static void handle_rng_seed(const char* args); // New RNG seed command handler
 static void handle_set_vmap_hsv(const char* args);
+static void handle_enc_stats(const char* args);
+static void handle_midi_tx(const char* args);
+static void handle_midi_rx(const char* args);
+static void handle_midi_clock(const char* args);
+static void handle_latency(const char* args);
 
 static int console_sys_event_handler(void* event);
 
@@ -106,6 +117,25 @@ static const char set_vmap_hsv_help[] PROGMEM =
 		"Sets HSV values for vmap: <bank> <enc> <vmap_idx> <H (0-1535)> <S "
 		"(0-255)> <V (0-255)>";
 
+static const char enc_stats_name[] PROGMEM = "enc_stats";
+static const char enc_stats_help[] PROGMEM =
+		"Encoder signal quality stats: [reset]";
+
+static const char midi_tx_name[] PROGMEM = "midi_tx";
+static const char midi_tx_help[] PROGMEM =
+		"MIDI out queue stats: [reset|oldest|coalesce|newest|sof|loop]";
+
+static const char midi_rx_name[] PROGMEM = "midi_rx";
+static const char midi_rx_help[] PROGMEM = "MIDI in stats: [reset]";
+
+static const char midi_clock_name[] PROGMEM = "midi_clock";
+static const char midi_clock_help[] PROGMEM =
+		"Tempo and position of the received MIDI clock";
+
+static const char latency_name[] PROGMEM = "latency";
+static const char latency_help[] PROGMEM =
+		"Input to USB and USB to LED latency: [reset]";
+
 static const console_command_t commands[] PROGMEM = {
 		{.name			= help_command_name,
 		 .handler		= handle_help,
@@ -128,6 +158,21 @@ static const console_command_t commands[] PROGMEM = {
 		{.name			= set_vmap_hsv_name,
 		 .handler		= handle_set_vmap_hsv,
 		 .help_text = set_vmap_hsv_help},
+		{.name			= enc_stats_name,
+		 .handler		= handle_enc_stats,
+		 .help_text = enc_stats_help},
+		{.name			= midi_tx_name,
+		 .handler		= handle_midi_tx,
+		 .help_text = midi_tx_help},
+		{.name			= midi_rx_name,
+		 .handler		= handle_midi_rx,
+		 .help_text = midi_rx_help},
+		{.name			= midi_clock_name,
+		 .handler		= handle_midi_clock,
+		 .help_text = midi_clock_help},
+		{.name			= latency_name,
+		 .handler		= handle_latency,
+		 .help_text = latency_help},
 };
 
 static const uint8_t num_commands = sizeof(commands) / sizeof(commands[0]);
@@ -554,8 +599,7 @@ static void handle_set_vmap_hsv(const char* args) {
 	}
 
 	// Validate input ranges
-	if (bank >= NUM_ENC_BANKS || enc >= NUM_ENCODERS ||
-			vmap_idx >= NUM_VMAPS_PER_ENC) {
+	if (vmap_id(bank, enc, vmap_idx) == VMAP_ID_NONE) {
 		console_puts_p(PSTR("Invalid bank, encoder, or vmap index\r\n"));
 		return;
 	}
@@ -565,3 +609,179 @@ static void handle_set_vmap_hsv(const char* args) {
 
 	console_puts_p(PSTR("HSV color set\r\n"));
 }
+
+/**
+ * @brief Command handler for the encoder signal quality statistics
+ *
+ * Prints the invalid transition count, reversals within a detent and the
+ * maximum observed step rate for each encoder, or clears them.
+ *
+ * @param args Command arguments, "reset" to clear the statistics
+ */
+static void handle_enc_stats(const char* args) {
+	char buffer[CONSOLE_LINE_BUFFER_SIZE];
+
+	if (strcasecmp(args, "reset") == 0) {
+		for (uint8_t i = 0; i < NUM_ENCODERS; i++) {
+			quadrature_stats_reset(&gQUAD_ENC[i]);
+		}
+		console_puts_p(PSTR("Encoder stats cleared\r\n"));
+		return;
+	}
+
+	console_puts_p(PSTR("Enc  Invalid  Reversals  Max steps/s\r\n"));
+	for (uint8_t i = 0; i < NUM_ENCODERS; i++) {
+		const struct quadrature* quad = &gQUAD_ENC[i];
+		snprintf_P(buffer, sizeof(buffer), PSTR("%3u  %7u  %9u  %11u\r\n"), i,
+							 quad->stats.invalid, quad->stats.reversals,
+							 quadrature_max_step_rate(quad));
+		console_puts(buffer);
+	}
+}
+
+/**
+ * @brief Handles the 'midi_tx' command
+ *
+ * Prints the MIDI out queue counters and overflow policy, clears the counters,
+ * selects the policy used when the host stops reading, or selects whether the
+ * queue is sent once per USB frame ("sof") or on every main loop ("loop").
+ *
+ * @param args Command arguments, "reset", a policy name, "sof" or "loop"
+ */
+static void handle_midi_tx(const char* args) {
+	char									 buffer[CONSOLE_LINE_BUFFER_SIZE];
+	struct midi_tx_stats stats;
+
+	if (strcasecmp(args, "reset") == 0) {
+		midi_tx_reset_stats();
+		console_puts_p(PSTR("MIDI out stats cleared\r\n"));
+		return;
+	} else if (strcasecmp(args, "oldest") == 0) {
+		gCONFIG.midi_tx_policy = MIDI_TX_DROP_OLDEST;
+	} else if (strcasecmp(args, "coalesce") == 0) {
+		gCONFIG.midi_tx_policy = MIDI_TX_COALESCE;
+	} else if (strcasecmp(args, "newest") == 0) {
+		gCONFIG.midi_tx_policy = MIDI_TX_DROP_NEWEST;
+	} else if (strcasecmp(args, "sof") == 0) {
+		gCONFIG.midi_tx_sof = true;
+	} else if (strcasecmp(args, "loop") == 0) {
+		gCONFIG.midi_tx_sof = false;
+	}
+
+	midi_tx_get_stats(&stats);
+	snprintf_P(buffer, sizeof(buffer),
+						 PSTR("Policy %u, %s, sent %u, high water %u/%u\r\n"),
+						 gCONFIG.midi_tx_policy,
+						 gCONFIG.midi_tx_sof ? "frame aligned" : "every loop", stats.sent,
+						 stats.high_water, MIDI_TX_RING_SIZE);
+	console_puts(buffer);
+	snprintf_P(buffer, sizeof(buffer),
+						 PSTR("Dropped oldest %u, newest %u, coalesced %u\r\n"),
+						 stats.dropped_oldest, stats.dropped_newest, stats.coalesced);
+	console_puts(buffer);
+}
+
+/**
+ * @brief Handles the 'midi_rx' command
+ *
+ * Prints the MIDI in counters, or clears them.
+ *
+ * @param args Command arguments, "reset" to clear the counters
+ */
+static void handle_midi_rx(const char* args) {
+	char									 buffer[CONSOLE_LINE_BUFFER_SIZE];
+	struct midi_rx_stats stats;
+
+	if (strcasecmp(args, "reset") == 0) {
+		midi_rx_reset_stats();
+		console_puts_p(PSTR("MIDI in stats cleared\r\n"));
+		return;
+	}
+
+	midi_rx_get_stats(&stats);
+	snprintf_P(buffer, sizeof(buffer),
+						 PSTR("Received %u, dropped %u, backpressure %u\r\n"),
+						 stats.received, stats.dropped, stats.backpressure);
+	console_puts(buffer);
+}
+
+/**
+ * @brief Handles the 'midi_clock' command
+ *
+ * Prints the tempo, transport state and beat position followed from the
+ * host's MIDI clock.
+ *
+ * @param args Command arguments (unused)
+ */
+static void handle_midi_clock(const char* args __attribute__((unused))) {
+	char									 buffer[CONSOLE_LINE_BUFFER_SIZE];
+	struct midi_clock_info info;
+
+	if (!midi_clock_get(&info, systime_us())) {
+		console_puts_p(PSTR("No MIDI clock\r\n"));
+		return;
+	}
+
+	snprintf_P(buffer, sizeof(buffer),
+						 PSTR("%u.%u BPM, %s, beat %lu, phase %u/65536\r\n"),
+						 info.bpm_x10 / 10, info.bpm_x10 % 10,
+						 info.running ? "playing" : "stopped",
+						 (unsigned long)info.beat, info.phase);
+	console_puts(buffer);
+}
+
+/**
+ * @brief Handles the 'latency' command
+ *
+ * Prints the min, mean and max, percentiles and histogram of each measured
+ * latency path, or clears them. Times are in microseconds, each histogram
+ * bin is labelled with its upper bound.
+ *
+ * @param args Command arguments, "reset" to clear the measurements
+ */
+static void handle_latency(const char* args) {
+	char								 buffer[CONSOLE_LINE_BUFFER_SIZE];
+	struct latency_stats stats;
+
+	if (strcasecmp(args, "reset") == 0) {
+		latency_reset();
+		console_puts_p(PSTR("Latency stats cleared\r\n"));
+		return;
+	}
+
+	for (u8 path = 0; path < LATENCY_PATH_NB; path++) {
+		latency_get(path, &stats);
+
+		if (path == LATENCY_INPUT_TO_USB) {
+			console_puts_p(PSTR("Input to USB: "));
+		} else {
+			console_puts_p(PSTR("USB to LED: "));
+		}
+
+		u16 mean = stats.count ? (u16)(stats.sum / stats.count) : 0;
+		snprintf_P(buffer, sizeof(buffer),
+							 PSTR("%u events, min %lu, mean %lu, max %lu us\r\n"),
+							 stats.count, (unsigned long)stats.min * LATENCY_TAG_US,
+							 (unsigned long)mean * LATENCY_TAG_US,
+							 (unsigned long)stats.max * LATENCY_TAG_US);
+		console_puts(buffer);
+
+		snprintf_P(
+				buffer, sizeof(buffer), PSTR("  p50 %lu, p90 %lu, p99 %lu us\r\n"),
+				(unsigned long)latency_percentile(&stats, 50) * LATENCY_TAG_US,
+				(unsigned long)latency_percentile(&stats, 90) * LATENCY_TAG_US,
+				(unsigned long)latency_percentile(&stats, 99) * LATENCY_TAG_US);
+		console_puts(buffer);
+
+		for (u8 b = 0; b < LATENCY_BINS; b++) {
+			if (b == LATENCY_BINS - 1) {
+				snprintf_P(buffer, sizeof(buffer), PSTR("  >=%lu us: %u\r\n"),
+									 (unsigned long)(1UL << b) * LATENCY_TAG_US, stats.bins[b]);
+			} else {
+				snprintf_P(buffer, sizeof(buffer), PSTR("  <%lu us: %u\r\n"),
+									 (unsigned long)(2UL << b) * LATENCY_TAG_US, stats.bins[b]);
+			}
+			console_puts(buffer);
+		}
+	}
+}
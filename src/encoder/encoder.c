@@ -6,109 +6,129 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 #include <stdio.h>
+#include <avr/pgmspace.h>
 #include "console/console.h"
 #include "io/encoder.h"
 #include "event/event.h"
 #include "event/io.h"
 #include "system/time.h" // Include for systime_ms
+#include "system/utility.h"
 #include <stdint.h>
 #include <assert.h> // Include for assert
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-#define THR_VERY_SLOW		 150
-#define THR_SLOW				 75
-#define THR_MEDIUM			 30
-#define THR_FAST				 10
-
-// Corresponding acceleration factors - Higher value = more acceleration
-#define FACTOR_BASE			 1
-#define FACTOR_SLOW			 2
-#define FACTOR_MEDIUM		 3
-#define FACTOR_FAST			 5
-#define FACTOR_VERY_FAST 7 // Factor when t < THR_FAST
+#define G(x) ENC_ACCEL_GAIN(x)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static u16 accel_gain(u8 profile, u32 interval);
+
+STATIC_ASSERT(ENC_ACCEL_INTERVAL_MAX < ENC_RECENT_TIME,
+							"A recent detent must cover the acceleration table");
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+	Acceleration curves, one row per profile. The column is the time since the
+	previous detent in steps of 16ms (0-15ms, 16-31ms, ...), the value is the
+	number of steps applied for that detent in 8.8 fixed point.
+	The default profile is a close match to the original threshold/factor chain.
+*/
+// clang-format off
+static const u16 accel_lut[ENC_ACCEL_PROFILE_NB][ENC_ACCEL_LUT_SIZE] PROGMEM = {
+	[ENC_ACCEL_PROFILE_LINEAR]	= {G(1), G(1), G(1), G(1), G(1), G(1), G(1), G(1), G(1), G(1), G(1), G(1)},
+	[ENC_ACCEL_PROFILE_FINE]		= {G(2), G(1.5), G(1.25), G(1), G(1), G(0.75), G(0.75), G(0.5), G(0.5), G(0.5), G(0.5), G(0.5)},
+	[ENC_ACCEL_PROFILE_DEFAULT] = {G(7), G(5), G(3), G(3), G(3), G(2), G(2), G(2), G(2), G(2), G(1), G(1)},
+	[ENC_ACCEL_PROFILE_SWEEP]		= {G(12), G(10), G(8), G(6), G(5), G(4), G(3), G(3), G(2), G(2), G(2), G(1)},
+	[ENC_ACCEL_PROFILE_HIRES]		= {G(8), G(4), G(2), G(1), G(0.5), G(0.25), G(0.125), G(0.0625), G(0.03125), G(0.015625), G(0.015625), G(0.015625)},
+};
+// clang-format on
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int encoder_movement_init(struct encoder_movement* enc) {
 	assert(enc);
-	enc->velocity		= 0;
-	enc->direction	= 0;
-	enc->accel_mode = 0;
+	enc->velocity			 = 0;
+	enc->delta				 = 0;
+	enc->direction		 = 0;
+	enc->accel_profile = ENC_ACCEL_PROFILE_DEFAULT;
 
 	// Initialize time-based acceleration state
-	enc->last_update_time = systime_ms();
-	enc->accel_factor			= 1;
+	enc->last_detent_time = systime_us();
+	enc->interval					= ENC_ACCEL_INTERVAL_MAX;
+	enc->accel_gain				= G(1);
+	enc->accel_frac				= 0;
+	enc->recent						= false;
 
 	return 0;
 }
 
-bool encoder_movement_update(struct encoder_movement* enc, int new_direction) {
+bool encoder_movement_update(struct encoder_movement* enc, int new_direction,
+														 u32 timestamp) {
 	assert(enc);
 
-	u32 current_time = systime_ms();
-
 	// If encoder stopped
 	if (new_direction == 0) {
-		enc->velocity			= 0;
-		enc->direction		= 0;
-		enc->accel_factor = 1;
+		enc->velocity = 0;
+		enc->delta		= 0;
 		return false; // No change
 	}
 
-	u32 time_delta				= current_time - enc->last_update_time;
-	enc->last_update_time = current_time;
-
-	// Determine the base acceleration factor based on time delta
-	u16 current_accel_factor = 1; // Default factor
-
-	if (time_delta == 0) {
-		// Assign max acceleration if delta is zero (very fast)
-		current_accel_factor = FACTOR_VERY_FAST;
-	} else if (time_delta < THR_FAST) { // < 10ms
-		current_accel_factor = FACTOR_VERY_FAST;
-	} else if (time_delta < THR_MEDIUM) { // 10ms to 29ms
-		current_accel_factor = FACTOR_FAST;
-	} else if (time_delta < THR_SLOW) { // 30ms to 74ms
-		current_accel_factor = FACTOR_MEDIUM;
-	} else if (time_delta < THR_VERY_SLOW) { // 75ms to 149ms
-		current_accel_factor = FACTOR_SLOW;
-	} else { // >= 150ms
-		current_accel_factor = FACTOR_BASE;
+	// An old last_detent_time may have wrapped to look recent, it is slow
+	u32 interval = ENC_ACCEL_INTERVAL_MAX;
+	if (enc->recent) {
+		interval = MIN(timestamp - enc->last_detent_time, ENC_ACCEL_INTERVAL_MAX);
 	}
 
-	// Handle direction changes - Optional: Reset to base speed on change?
+	enc->last_detent_time = timestamp;
+	enc->recent						= true;
+
 	if (new_direction != enc->direction) {
-		enc->direction = (i8)new_direction;
-		// Option: uncomment below to force slow speed on direction change
-		// current_accel_factor = FACTOR_BASE;
+		// A change of direction discards any partial step from the other
+		// direction, and restarts the interval estimate.
+		enc->direction	= (i8)new_direction;
+		enc->accel_frac = 0;
+		enc->interval		= interval;
+	} else if (interval == ENC_ACCEL_INTERVAL_MAX) {
+		// Turning resumed after a pause, start again from slow
+		enc->interval = interval;
+	} else if (interval > enc->interval) {
+		enc->interval += (interval - enc->interval) >> ENC_INTERVAL_EMA_SHIFT;
+	} else {
+		enc->interval -= (enc->interval - interval) >> ENC_INTERVAL_EMA_SHIFT;
 	}
 
-	// Store the decided factor
-	enc->accel_factor = current_accel_factor;
+	enc->accel_gain = accel_gain(enc->accel_profile, enc->interval);
 
-	// Calculate velocity based on direction and the current acceleration factor
-	i16 base_velocity = enc->direction; // +1 or -1
-	enc->velocity			= base_velocity * enc->accel_factor;
+	// Whole steps are applied now, the remainder is carried to the next detent
+	u16 steps				= enc->accel_gain + enc->accel_frac;
+	enc->accel_frac = (u8)(steps & ((1 << ENC_ACCEL_FRAC_BITS) - 1));
+	steps >>= ENC_ACCEL_FRAC_BITS;
 
-	// Apply velocity bounds
-	const i16 ENC_MAX_VELOCITY =
-			50; // Example max overall velocity change per update (adjust as needed)
-	if (enc->velocity > ENC_MAX_VELOCITY) {
-		enc->velocity = ENC_MAX_VELOCITY;
-	} else if (enc->velocity < -ENC_MAX_VELOCITY) {
-		enc->velocity = -ENC_MAX_VELOCITY;
-	}
+	enc->velocity = (i16)(enc->direction * (i16)steps);
+	enc->delta		= (i16)(enc->direction * (i16)enc->accel_gain);
+
+	return true;
+}
 
-	// // Debug output
-	// static char buffer[40];
-	// snprintf(buffer, sizeof(buffer), "v:%d f:%u t:%lu d:%d\r\n", enc->velocity,
-	// 				 enc->accel_factor, time_delta, enc->direction);
-	// console_puts(buffer);
-	return true; // Encoder moved
+void encoder_movement_expire(struct encoder_movement* enc, u32 now) {
+	if (enc->recent && (now - enc->last_detent_time) >= ENC_RECENT_TIME) {
+		enc->recent = false;
+	}
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static u16 accel_gain(u8 profile, u32 interval) {
+	if (profile >= ENC_ACCEL_PROFILE_NB) {
+		profile = ENC_ACCEL_PROFILE_DEFAULT;
+	}
+
+	u32 idx = interval >> ENC_ACCEL_INTERVAL_SHIFT;
+	idx			= MIN(idx, ENC_ACCEL_LUT_SIZE - 1);
+
+	return pgm_read_word(&accel_lut[profile][idx]);
+}
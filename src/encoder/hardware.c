@@ -14,6 +14,7 @@
 #include "lfo/lfo.h"
 
 #include "system/hardware.h"
+#include "system/time.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -46,8 +47,7 @@ void hw_encoder_init(void) {
 	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 1);
 
 	for (uint i = 0; i < NUM_ENCODERS; i++) {
-		gQUAD_ENC[i].dir = 0;
-		gQUAD_ENC[i].rot = 0;
+		quadrature_init(&gQUAD_ENC[i]);
 	}
 }
 
@@ -56,6 +56,10 @@ void hw_encoder_scan(void) {
 	// Latch the IO levels into the shift registers
 	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 1);
 
+	// All inputs are sampled at the latch, a single timestamp is used for any
+	// detents decoded during this scan.
+	u32 now = systime_us();
+
 	// Clock the 16 data bits for the encoder switches
 	u16 swstates = 0;
 	for (size_t i = 0; i < NUM_ENCODER_SWITCHES; i++) {
@@ -78,7 +82,7 @@ void hw_encoder_scan(void) {
 		u8 ch_b = (bool)gpio_get(&PORT_SR_ENC, PIN_SR_ENC_DATA_IN);
 		gpio_set(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, 1);
 
-		quadrature_update(&gQUAD_ENC[i], ch_a, ch_b);
+		quadrature_update(&gQUAD_ENC[i], ch_a, ch_b, now);
 	}
 
 	// Close the door!
@@ -10,6 +10,7 @@
 #include "event/io.h"
 
 #include "io/quadrature.h"
+#include "system/utility.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -55,12 +56,78 @@ static const enum quad_state quad_states[QUAD_NB][4] = {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-void quadrature_update(struct quadrature* ctx, uint ch_a, uint ch_b) {
+void quadrature_init(struct quadrature* ctx) {
+	assert(ctx);
+
+	ctx->dir				 = DIR_ST;
+	ctx->rot				 = QUAD_START;
+	ctx->code				 = QUAD_CODE_UNKNOWN;
+	ctx->prev_code	 = QUAD_CODE_UNKNOWN;
+	ctx->detent_time = 0;
+	ctx->step_time	 = 0;
+	quadrature_stats_reset(ctx);
+}
+
+void quadrature_update(struct quadrature* ctx, uint ch_a, uint ch_b, u32 now) {
 	assert(ctx);
 
 	uint val = (ch_b << 1) | ch_a;
-	ctx->rot = quad_states[ctx->rot & 0x0F][val];
-	ctx->dir = ctx->rot & 0x30;
+
+	if (ctx->code != QUAD_CODE_UNKNOWN && ctx->code != val) {
+		if ((ctx->code ^ val) == 0x03) {
+			// Both channels changed between scans, at least one step was missed.
+			// The state table will fall back to QUAD_START.
+			if (ctx->stats.invalid < UINT16_MAX) {
+				ctx->stats.invalid++;
+			}
+		} else {
+			// Stepping back to the previous code while part way through a detent
+			if (val == ctx->prev_code && (ctx->rot & 0x0F) != QUAD_START &&
+					ctx->stats.reversals < UINT16_MAX) {
+				ctx->stats.reversals++;
+			}
+
+			u32 interval = now - ctx->step_time;
+			if (ctx->step_time != 0 && interval < ctx->stats.min_step_interval) {
+				ctx->stats.min_step_interval = interval;
+			}
+			ctx->step_time = now;
+		}
+
+		ctx->prev_code = ctx->code;
+	}
+
+	ctx->code = val;
+	ctx->rot	= quad_states[ctx->rot & 0x0F][val];
+	ctx->dir	= ctx->rot & 0x30;
+
+	if (ctx->dir) {
+		ctx->detent_time = now;
+	}
+}
+
+void quadrature_stats_reset(struct quadrature* ctx) {
+	assert(ctx);
+
+	ctx->stats.invalid					 = 0;
+	ctx->stats.reversals				 = 0;
+	ctx->stats.min_step_interval = UINT32_MAX;
+}
+
+u16 quadrature_max_step_rate(const struct quadrature* ctx) {
+	assert(ctx);
+
+	u32 interval = ctx->stats.min_step_interval;
+
+	if (interval == UINT32_MAX) {
+		return 0;
+	} else if (interval == 0) {
+		// Two steps within one timestamp, report the upper bound
+		return UINT16_MAX;
+	}
+
+	u32 rate = 1000000UL / interval;
+	return (u16)MIN(rate, UINT16_MAX);
 }
 
 inline int quadrature_direction(struct quadrature* ctx) {
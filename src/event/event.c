@@ -203,6 +203,16 @@ int event_post(enum event_ch ch, void* event) {
 	return 0;
 }
 
+uint event_queue_free(enum event_ch ch) {
+	assert(ch < EVENT_CHANNEL_NB);
+
+	struct event_channel* channel = channels[ch];
+	assert(channel);
+
+	// The last entry is never used, see event_post()
+	return (channel->queue_size - 1) - channel->head;
+}
+
 int event_post_rt(enum event_ch ch, void* event) {
 	assert(event);
 	assert(ch < EVENT_CHANNEL_NB);
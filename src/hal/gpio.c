@@ -30,6 +30,16 @@ void gpio_mode(PORT_t* port, u8 pin, PORT_OPC_t mode) {
 	*ctrl |= (u8)mode;         // Set the new mode
 }
 
+void gpio_sense(PORT_t* port, u8 pin, PORT_ISC_t sense) {
+	assert(port);
+	assert(pin < 8);
+
+	volatile u8* ctrl = &port->PIN0CTRL + pin;
+
+	*ctrl &= (u8)~PORT_ISC_gm; // Clear all ISC bits
+	*ctrl |= (u8)sense;        // Set the new input sense configuration
+}
+
 void gpio_dir(PORT_t* port, u8 pin, enum gpio_dir dir) {
 	assert(port);
 
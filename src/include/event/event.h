@@ -167,6 +167,15 @@ int event_channel_unsubscribe(enum event_ch ch, struct event_ch_handler* h);
  */
 int event_post(enum event_ch ch, void* event);
 
+/**
+ * @brief Get the number of events that can still be posted to a channel
+ * before it is next processed.
+ *
+ * @param ch Enum of the event channel.
+ * @return uint Number of free queue entries.
+ */
+uint event_queue_free(enum event_ch ch);
+
 /**
  * @brief Process an event immediately (real-time)
  *
@@ -23,6 +23,16 @@ extern struct event_channel midi_out_event_ch;
 enum midi_event {
 	MIDI_EVENT_CC,
 	MIDI_EVENT_SYSEX,
+	MIDI_EVENT_NRPN,
+	MIDI_EVENT_CC_14,
+	MIDI_EVENT_NOTE_OFF,
+	MIDI_EVENT_NOTE_ON,
+	MIDI_EVENT_POLY_PRESSURE,
+	MIDI_EVENT_PROGRAM,
+	MIDI_EVENT_CHAN_PRESSURE,
+	MIDI_EVENT_PITCH_BEND,
+	MIDI_EVENT_SYSTEM, // System common and realtime
+	MIDI_EVENT_CC_REL, // Relative CC, a delta (data.cc)
 
 	MIDI_EVENT_NB,
 };
@@ -47,6 +57,42 @@ typedef struct __attribute__((packed)) {
 	u8 value;
 } midi_cc_event_s;
 
+// Note on/off and polyphonic pressure
+typedef struct __attribute__((packed)) {
+	u8 channel;
+	u8 note;
+	u8 value; // Velocity or pressure
+} midi_note_event_s;
+
+// Program change and channel pressure
+typedef struct __attribute__((packed)) {
+	u8 channel;
+	u8 value;
+} midi_chan_event_s;
+
+typedef struct __attribute__((packed)) {
+	u8	channel;
+	u16 value; // 14-bit, 0x2000 is centre
+} midi_bend_event_s;
+
+typedef struct __attribute__((packed)) {
+	u8 status;
+	u8 data[2]; // Unused bytes are 0
+} midi_system_event_s;
+
+typedef struct __attribute__((packed)) {
+	u8	channel;
+	u8	control; // MSB control, the LSB is control + 32
+	u16 value;	 // 14-bit value
+} midi_cc14_event_s;
+
+typedef struct __attribute__((packed)) {
+	u8	channel;
+	u8	rpn;	 // Registered (RPN) rather than non-registered (NRPN)
+	u16 param; // 14-bit parameter number
+	u16 value; // 14-bit value
+} midi_nrpn_event_s;
+
 typedef struct __attribute__((packed)) {
 	u8 type; // enum midi_sysex_type
 	u8 data[3];
@@ -60,9 +106,16 @@ typedef struct __attribute__((packed)) {
 } midi_sysex_out_event_s;
 
 typedef struct __attribute__((packed)) {
-	u8 type;
+	u8	type;
+	u16 stamp; // Latency tag, see system/latency.h
 	union {
 		midi_cc_event_s				 cc;
+		midi_cc14_event_s			 cc14;
+		midi_nrpn_event_s			 nrpn;
+		midi_note_event_s			 note;
+		midi_chan_event_s			 chan;
+		midi_bend_event_s			 bend;
+		midi_system_event_s		 system;
 		midi_sysex_in_event_s	 sysex_in;
 		midi_sysex_out_event_s sysex_out;
 	} data;
@@ -22,6 +22,7 @@ enum gpio_dir {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void gpio_mode(PORT_t* port, u8 pin, PORT_OPC_t mode);
+void gpio_sense(PORT_t* port, u8 pin, PORT_ISC_t sense);
 void gpio_dir(PORT_t* port, u8 pin, enum gpio_dir dir);
 void gpio_set(PORT_t* port, u8 pin, u8 state);
 u8	 gpio_get(PORT_t* port, u8 pin);
@@ -16,15 +16,47 @@
 #define ENC_MID		(ENC_MAX / 2) // Mid position encoder value
 #define ENC_RANGE (u8)(ENC_MAX - ENC_MIN)
 
+// Acceleration lookup tables are indexed by the time between detents, each
+// entry covers (1 << ENC_ACCEL_INTERVAL_SHIFT) us (~16ms). Intervals longer
+// than the table use the last entry.
+#define ENC_ACCEL_INTERVAL_SHIFT (14)
+#define ENC_ACCEL_LUT_SIZE			 (12)
+#define ENC_ACCEL_INTERVAL_MAX	 ((u32)ENC_ACCEL_LUT_SIZE << ENC_ACCEL_INTERVAL_SHIFT)
+
+// last_detent_time is only compared with the time while it is this recent (us).
+// The us timer wraps after ~71 minutes, see encoder_movement_expire().
+#define ENC_RECENT_TIME					 (1000000UL)
+
+// Smoothing of the detent interval estimate, alpha = 1 / (1 << shift)
+#define ENC_INTERVAL_EMA_SHIFT	 (2)
+
+// Acceleration gains are unsigned 8.8 fixed point (256 = 1 step per detent)
+#define ENC_ACCEL_FRAC_BITS			 (8)
+#define ENC_ACCEL_GAIN(x)				 (u16)((x) * (1 << ENC_ACCEL_FRAC_BITS))
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+enum encoder_accel_profile {
+	ENC_ACCEL_PROFILE_LINEAR,	 // No acceleration, one step per detent
+	ENC_ACCEL_PROFILE_FINE,		 // Sub-step resolution when turned slowly
+	ENC_ACCEL_PROFILE_DEFAULT, // General purpose
+	ENC_ACCEL_PROFILE_SWEEP,	 // Aggressive, for filter sweeps etc.
+	ENC_ACCEL_PROFILE_HIRES,	 // Wide dynamic range for high resolution vmaps
+
+	ENC_ACCEL_PROFILE_NB,
+};
+
 struct encoder_movement {
-	i16 velocity;					// Current rotational velocity
-	u8	accel_mode;				// Acceleration mode (Currently unused, placeholder)
+	i16 velocity;					// Current rotational velocity (whole steps)
+	i16 delta;						// Movement of the last detent (8.8 fixed point)
+	u8	accel_profile;		// Acceleration profile (enum encoder_accel_profile)
 	i8	direction;				// Current direction (-1, 0, 1)
-	u32 last_update_time; // Last time the encoder was updated
-	u16 accel_factor;			// Acceleration factor (1-7)
+	u32 last_detent_time; // Timestamp of the last detent (us)
+	u32 interval;					// Smoothed time between detents (us)
+	u16 accel_gain;				// Last acceleration gain (8.8 fixed point)
+	u8	accel_frac;				// Fractional step carried to the next detent
+	u8	recent;						// last_detent_time is within ENC_RECENT_TIME
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -39,15 +71,34 @@ int encoder_movement_init(struct encoder_movement* enc);
 
 /**
  * @brief Perform an update of an encoder.
- * This function takes as input the hardware state of channel A and B
- * of the quadrature encoder, it then processes any change in encoder state
- * and generates an encoder rotation event if required.
+ * This function takes as input the decoded direction of the quadrature
+ * encoder and the time the detent was captured, it then processes any change
+ * in encoder state.
  *
  * This uses a time-based acceleration algorithm to calculate the velocity
- * based on how quickly the encoder is turned.
+ * based on how quickly the encoder is turned. The time between detents is
+ * smoothed with an exponential moving average of the capture timestamps, so
+ * main loop jitter does not affect the result. The gain for each detent is
+ * looked up from the encoder's acceleration profile, fractional steps are
+ * carried over to the next detent in the same direction.
+ *
+ * The velocity holds the whole number of steps to apply, the unrounded
+ * movement is available in delta for high resolution consumers.
  *
  * @param enc Pointer to encoder device.
  * @param direction Current direction of encoder (-1, 0, +1)
- * @return 1 if display needs to be updated
+ * @param timestamp Capture time of the detent (us), see systime_us()
+ * @return 1 if the encoder moved by a detent
+ */
+bool encoder_movement_update(struct encoder_movement* enc, int direction,
+														 u32 timestamp);
+
+/**
+ * @brief Forget the time of the last detent once it is ENC_RECENT_TIME old,
+ * the next detent is then treated as slow. Must be called for every encoder
+ * well within the wrap of the us timer (~71 minutes).
+ *
+ * @param enc Pointer to encoder device.
+ * @param now The current time (us), see systime_us()
  */
-bool encoder_movement_update(struct encoder_movement* enc, int direction);
+void encoder_movement_expire(struct encoder_movement* enc, u32 now);
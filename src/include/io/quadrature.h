@@ -7,25 +7,64 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
-/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define QUAD_CODE_UNKNOWN (0xFF)
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+// Signal quality counters, the counters saturate rather than wrap
+struct quadrature_stats {
+	u16 invalid;					 // Transitions where both channels changed at once
+	u16 reversals;				 // Direction reversals part way through a detent
+	u32 min_step_interval; // Shortest time between two valid steps (us)
+};
+
 struct quadrature {
-	u8 dir; // Current direction
-	u8 rot; // Rotational state
+	u8	dir;				 // Current direction
+	u8	rot;				 // Rotational state
+	u8	code;				 // Last Gray code (QUAD_CODE_UNKNOWN before first scan)
+	u8	prev_code;	 // Gray code before the last step
+	u32 detent_time; // Time of the last detent (us), captured at scan time
+	u32 step_time;	 // Time of the last valid step (us)
+
+	struct quadrature_stats stats;
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/**
+ * @brief Reset a quadrature context, including its statistics.
+ *
+ * @param ctx Pointer to quadrature context.
+ */
+void quadrature_init(struct quadrature* ctx);
+
 /**
  * @brief Processes the input from a quadrature encoder and returns
  * a direction.
+ * Invalid transitions and reversals are counted in the context statistics.
  *
  * @param ctx Pointer to quadrature context.
  * @param ch_a Current value of channel A.
  * @param ch_b Current value of channel B.
+ * @param now Time the channels were sampled (us).
+ */
+void quadrature_update(struct quadrature* ctx, uint ch_a, uint ch_b, u32 now);
+
+/**
+ * @brief Clear the signal quality statistics of a quadrature encoder.
+ *
+ * @param ctx Pointer to quadrature context.
+ */
+void quadrature_stats_reset(struct quadrature* ctx);
+
+/**
+ * @brief Get the maximum observed step rate of a quadrature encoder.
+ *
+ * @param ctx Pointer to quadrature context.
+ * @return u16 Steps per second (0 if no steps have been observed).
  */
-void quadrature_update(struct quadrature* ctx, uint ch_a, uint ch_b);
+u16 quadrature_max_step_rate(const struct quadrature* ctx);
 
 /**
  * @brief Get the last known direction of a quadrature encoder.
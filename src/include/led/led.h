@@ -33,3 +33,13 @@ int display_init(void);
  * @brief Periodic display update.
  */
 void display_update(void);
+
+/**
+ * @brief Request a redraw of an encoder in the current bank. Requests are
+ * coalesced, each encoder is redrawn at most once per refresh period however
+ * often it is marked. Any redraw of the encoder (mf_draw_encoder()) clears the
+ * request.
+ *
+ * @param enc_idx Index of the encoder.
+ */
+void display_mark_dirty(u8 enc_idx);
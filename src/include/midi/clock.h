@@ -0,0 +1,61 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	MIDI clock follower.
+
+	Timing clock ticks (24 per beat) are timestamped as they are read from the
+	endpoint, without going through the MIDI in queue, and tracked by a second
+	order PLL: each tick corrects the predicted time of the next tick by half of
+	its error, and the tick period by a sixteenth of it. The result is a steady
+	tempo and a beat phase that can be read between ticks, for syncing LED
+	effects and modulation to the host.
+
+	Start, Continue, Stop and Song Position Pointer set the transport state and
+	the beat count. Tempo is tracked while the transport is stopped, since
+	most hosts send clock all the time.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "event/midi.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MIDI_CLOCK_PPQN (24) // Ticks per beat
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct midi_clock_info {
+	bool running;	// Transport is playing
+	u16	 bpm_x10; // Tempo in tenths of a BPM
+	u32	 beat;		// Beats since Start (or the song position)
+	u16	 phase;		// Position within the beat, 0 to 0xFFFF
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Handle a received system message if it is a clock or transport
+ * message. Called directly by the USB-MIDI decoder.
+ *
+ * @param msg The message.
+ * @param now_us Time the message was read (see systime_us).
+ * @return true The message was consumed.
+ * @return false Not a clock message.
+ */
+bool midi_clock_rx(const midi_system_event_s* msg, u32 now_us);
+
+/**
+ * @brief Get the current tempo and beat position.
+ *
+ * @param info Filled in when the clock is locked.
+ * @param now_us Current time (see systime_us).
+ * @return true The host is sending clock and the tempo is locked.
+ * @return false There is no clock, info is unchanged.
+ */
+bool midi_clock_get(struct midi_clock_info* info, u32 now_us);
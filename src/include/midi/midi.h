@@ -21,8 +21,13 @@ enum midi_mode {
 	MIDI_MODE_DISABLED,
 	MIDI_MODE_CC,
 	MIDI_MODE_CC_14,
-	MIDI_MODE_REL_CC,
+	MIDI_MODE_REL_CC, // Relative, two's complement (1 = +1, 127 = -1)
 	MIDI_MODE_NOTE,
+	MIDI_MODE_REL_CC_OFFSET,	 // Relative, binary offset (65 = +1, 63 = -1)
+	MIDI_MODE_REL_CC_SIGN_MAG, // Relative, sign-magnitude (1 = +1, 65 = -1)
+	MIDI_MODE_NRPN,						 // 14-bit non-registered parameter
+	MIDI_MODE_RPN,						 // 14-bit registered parameter
+	MIDI_MODE_PITCH_BEND,			 // 14-bit pitch bend, the CC number is unused
 };
 
 struct midi_cfg {
@@ -32,6 +37,14 @@ struct midi_cfg {
 		enum midi_cc cc;
 		u8					 raw;
 	};
+	u8						 param_msb; // NRPN/RPN parameter number MSB, raw is the LSB
+};
+
+// Counters are in USB-MIDI packets and wrap
+struct midi_rx_stats {
+	u16 received;			// Read from the endpoint
+	u16 dropped;			// Lost because MIDI in was full
+	u16 backpressure; // Passes that left packets in the endpoint for later
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -40,6 +53,9 @@ struct midi_cfg {
 int midi_init(void);
 int midi_update(void);
 
+void midi_rx_get_stats(struct midi_rx_stats* stats);
+void midi_rx_reset_stats(void);
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
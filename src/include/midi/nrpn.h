@@ -0,0 +1,52 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	NRPN/RPN to CC expansion with a per-channel state cache.
+
+	A receiver remembers the last parameter number and Data Entry MSB selected
+	on each channel, so they are only sent when they change. While a knob is
+	turned this is usually a single Data Entry LSB message instead of four.
+
+	Every other CC sent on the wire must be passed to midi_nrpn_observe() so
+	that a plain CC which touches the parameter or Data Entry controllers
+	invalidates the cache.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "event/midi.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MIDI_NRPN_MAX_CC (4) // Parameter MSB/LSB, Data Entry MSB/LSB
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Forget the state of every channel, the next message on each channel
+ * is sent in full.
+ */
+void midi_nrpn_reset(void);
+
+/**
+ * @brief Expand an NRPN/RPN message into the CCs that must be sent, skipping
+ * the parts the receiver already has.
+ *
+ * @param nrpn The message to send.
+ * @param cc Filled with up to MIDI_NRPN_MAX_CC CCs, in sending order.
+ * @return u8 The number of CCs to send.
+ */
+u8 midi_nrpn_encode(const midi_nrpn_event_s* nrpn, midi_cc_event_s* cc);
+
+/**
+ * @brief Update the cache for a plain CC that was sent.
+ *
+ * @param cc The CC sent.
+ */
+void midi_nrpn_observe(const midi_cc_event_s* cc);
@@ -47,6 +47,16 @@ enum mf_sysex_param {
 	MF_SYSEX_PARAM_SIDE_SWITCH,
 	MF_SYSEX_PARAM_ACTIVE_BANK,
 
+	MF_SYSEX_PARAM_ENCODER_ACCEL_PROFILE,
+	MF_SYSEX_PARAM_VMAP_HIRES,
+	MF_SYSEX_PARAM_ENCODER_STATS,
+	MF_SYSEX_PARAM_VMAP_CURVE,
+	MF_SYSEX_PARAM_CURVE_POINT,
+	MF_SYSEX_PARAM_ENCODER_VMAP_COUNT,
+	MF_SYSEX_PARAM_SNAPSHOT,
+	MF_SYSEX_PARAM_LATENCY,
+	MF_SYSEX_PARAM_PING,
+
 	MF_SYSEX_PARAM_NB,
 };
 
@@ -72,6 +82,8 @@ typedef struct __attribute__((packed)) {
 		enum virtmap_display_mode vmap_display_mode;
 		enum virtmap_mode					vmap_mode;
 		u8												vmap_active;
+		u8												accel_profile;
+		u8												vmap_count;
 	} data;
 } mf_sysex_encoder_param_s;
 
@@ -109,13 +121,27 @@ typedef struct __attribute__((packed)) {
 			u16 red;
 			u16 blue;
 		} rb;
+		bool hires;
+		u8	 curve;
 	} data;
 } mf_sysex_vmap_param_s;
 
+typedef struct __attribute__((packed)) {
+	u8 user_idx;	// User curve (0 to VMAP_CURVE_USER_NB - 1)
+	u8 point_idx; // Point (0 to VMAP_CURVE_POINTS - 1)
+	u8 value[2];	// 14-bit normalised output, MSB first
+} mf_sysex_curve_param_s;
+
+typedef struct __attribute__((packed)) {
+	u8 nonce[2]; // Chosen by the host, echoed in the reply
+} mf_sysex_ping_param_s;
+
 typedef union {
 	mf_sysex_encoder_param_s		enc;
 	mf_sysex_sideswitch_param_s sw;
 	mf_sysex_vmap_param_s				vmap;
+	mf_sysex_curve_param_s			curve;
+	mf_sysex_ping_param_s				ping;
 } mf_sysex_param_s;
 
 typedef struct __attribute__((packed)) {
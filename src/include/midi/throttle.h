@@ -0,0 +1,54 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	Per control output rate limiter.
+
+	A control may send at most one value per gCONFIG.midi_throttle_time ms.
+	Values that arrive inside the window are held (newest wins) and released by
+	midi_throttle_pop() once the window closes, so the final value of a fast
+	movement is always sent.
+
+	A control is a CC, a 14-bit CC pair (keyed on its MSB controller), an
+	NRPN/RPN parameter or the pitch bend of a channel. Multi-part messages are
+	held and released whole, with their full value. Other events, including
+	relative CCs whose values are deltas, are never held.
+
+	Only recently used controls are tracked (MIDI_THROTTLE_SLOTS). If every slot
+	is holding a value the event is sent immediately rather than dropped.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "event/midi.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MIDI_THROTTLE_SLOTS (16)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Check whether an outgoing event may be sent now. If not, the value is
+ * held until the window of the control closes.
+ *
+ * @param e The outgoing event.
+ * @return true Send the event now.
+ * @return false The value is held, see midi_throttle_pop().
+ */
+bool midi_throttle(const midi_event_s* e);
+
+/**
+ * @brief Get the next held value whose window has closed. Call repeatedly
+ * until it returns false.
+ *
+ * @param e Set to the event to send.
+ * @return true An event is ready to send.
+ * @return false There are no events ready.
+ */
+bool midi_throttle_pop(midi_event_s* e);
@@ -0,0 +1,100 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	Asynchronous USB-MIDI transmit ring.
+
+	Packets are queued in groups (a CC, a 14-bit pair, an NRPN message or a
+	sysex reply) and written to the IN endpoint by midi_tx_drain() only when
+	the endpoint bank is free. Nothing here waits for the host, if it stops
+	reading the ring fills and gCONFIG.midi_tx_policy decides what is lost:
+
+	- MIDI_TX_DROP_OLDEST discards queued groups to make room.
+	- MIDI_TX_COALESCE overwrites a queued group for the same control with the
+		new value, otherwise discards the oldest. Groups pushed with merge false
+		(relative CCs, whose values are deltas) are never overwritten.
+	- MIDI_TX_DROP_NEWEST discards the new group.
+
+	A group is never split between USB transactions. Dropping a group that
+	selects an NRPN/RPN parameter or sets the Data Entry MSB also drops the
+	Data Entry groups queued after it that depend on it.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "system/types.h"
+
+#include "LUFA/Drivers/USB/USB.h"
+#include "LUFA/Drivers/USB/Class/Common/MIDIClassCommon.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MIDI_TX_RING_SIZE (32) // Packets, must be a power of 2
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+enum midi_tx_policy {
+	MIDI_TX_DROP_OLDEST,
+	MIDI_TX_COALESCE,
+	MIDI_TX_DROP_NEWEST,
+
+	MIDI_TX_POLICY_NB,
+};
+
+// Counters are in packets and wrap
+struct midi_tx_stats {
+	u16 sent;
+	u16 dropped_oldest; // Discarded from the ring to make room
+	u16 dropped_newest; // Discarded instead of being queued
+	u16 coalesced;			// Overwritten in place by a newer value
+	u8	high_water;			// Most packets queued at once
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Queue a group of packets for transmission.
+ *
+ * @param pkt The packets.
+ * @param n Number of packets in the group.
+ * @param stamp Latency tag, recorded when the group is written to the
+ * endpoint (see system/latency.h).
+ * @param merge The group carries absolute values, a newer group for the same
+ * controls may replace it.
+ * @return true The group was queued (or merged into a queued group).
+ * @return false The group was dropped.
+ */
+bool midi_tx_push(const MIDI_EventPacket_t* pkt, u8 n, u16 stamp,
+									bool merge);
+
+/**
+ * @brief Write queued packets to the IN endpoint while it is free, call once
+ * per main loop. Never blocks.
+ *
+ * @param ep Address of the IN endpoint.
+ * @param ep_size Size of the IN endpoint (bytes).
+ */
+void midi_tx_drain(u8 ep, u8 ep_size);
+
+/**
+ * @brief Get the space left in the ring.
+ *
+ * @return u8 Number of packets that can be queued without dropping any.
+ */
+u8 midi_tx_free(void);
+
+/**
+ * @brief Get a copy of the transmit counters.
+ *
+ * @param stats Set to the counters.
+ */
+void midi_tx_get_stats(struct midi_tx_stats* stats);
+
+/**
+ * @brief Clear the transmit counters.
+ */
+void midi_tx_reset_stats(void);
@@ -16,6 +16,8 @@
 #define DEFAULT_ENC_PLAYDEAD_TIME	 (80)
 
 #define DEFAULT_MIDI_THROTTLE_TIME (10)
+#define DEFAULT_MIDI_TX_POLICY		 (MIDI_TX_COALESCE)
+#define DEFAULT_MIDI_TX_SOF				 (false)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -23,6 +25,8 @@
 struct sys_config {
 	u8 enc_dead_time;
 	u8 midi_throttle_time;
+	u8 midi_tx_policy; // enum midi_tx_policy
+	u8 midi_tx_sof;		 // Send MIDI out once per USB frame, after its SOF
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
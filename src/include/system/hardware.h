@@ -32,7 +32,9 @@
 
 #define NUM_ENC_BANKS							(3)
 #define NUM_ENC_PER_BANK					(NUM_ENCODERS)
-#define NUM_VMAPS_PER_ENC					(2)
+#define NUM_VMAPS_PER_ENC					(2) // Default vmaps per encoder
+#define VMAP_POOL_SIZE						(NUM_ENC_BANKS * NUM_ENCODERS * NUM_VMAPS_PER_ENC)
+#define VMAP_MAX_PER_ENC					(8)
 
 #define RGB_WHITE									(0x32DF) // red = max, blue = 12, green = 22
 #define RGB_MAX_VAL								(NUM_PWM_FRAMES)
@@ -110,7 +112,8 @@ struct encoder {
 	// Virtual Mappings
 	enum virtmap_mode vmap_mode;
 	u8								vmap_active; // Index for the current active vmap
-	struct virtmap		vmaps[NUM_VMAPS_PER_ENC];
+	u8								vmap_base;	 // First vmap in the pool (see virtmap/pool.h)
+	u8								vmap_count;	 // Number of vmaps in the pool
 
 	// Encoder Switch
 	enum switch_state sw_state;
@@ -0,0 +1,110 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	End-to-end latency measurement.
+
+	An event is stamped with a 16-bit tag where it starts (see latency_tag),
+	the tag travels with the event (midi_event_s.stamp, the transmit ring) and
+	the elapsed time is recorded where it ends. Two paths are measured:
+
+	- LATENCY_INPUT_TO_USB, from the quadrature scan that saw the detent to the
+		packet being written to the IN endpoint.
+	- LATENCY_USB_TO_LED, from the packet being read from the OUT endpoint to
+		the encoder LEDs being redrawn with the received value.
+
+	Times are kept in LATENCY_TAG_US units, so a tag covers about one second.
+	Each path keeps the count, min, max and mean, and a histogram with one bin
+	per power of 2 that the percentiles are estimated from.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "system/types.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define LATENCY_TAG_NONE (0)	// The event is not measured
+#define LATENCY_TAG_US	 (16) // Resolution of a tag (us)
+
+// Bin 0 is under 2 units, bin n is 2^n to 2^(n+1) - 1, the last is open
+#define LATENCY_BINS (12)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+enum latency_path {
+	LATENCY_INPUT_TO_USB,
+	LATENCY_USB_TO_LED,
+
+	LATENCY_PATH_NB,
+};
+
+// Times are in LATENCY_TAG_US units, counters saturate
+struct latency_stats {
+	u16 count;
+	u16 min;
+	u16 max;
+	u32 sum;
+	u16 bins[LATENCY_BINS];
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Make the tag of an event that starts now.
+ *
+ * @param now_us Time the event started (see systime_us).
+ * @return u16 The tag, never LATENCY_TAG_NONE.
+ */
+u16 latency_tag(u32 now_us);
+
+/**
+ * @brief Record the end of a measured event.
+ *
+ * @param path The path that the event took.
+ * @param tag Tag of the event, LATENCY_TAG_NONE is ignored.
+ */
+void latency_record(enum latency_path path, u16 tag);
+
+/**
+ * @brief Note that the LEDs of an encoder in the current bank must show a
+ * received value. The oldest pending tag is kept until the redraw.
+ *
+ * @param enc_idx Index of the encoder.
+ * @param tag Tag of the received message.
+ */
+void latency_led_pending(u8 enc_idx, u16 tag);
+
+/**
+ * @brief Record a redraw of an encoder, completing its pending tag if any.
+ *
+ * @param enc_idx Index of the encoder.
+ */
+void latency_led_drawn(u8 enc_idx);
+
+/**
+ * @brief Get a copy of the measurements of a path.
+ *
+ * @param path The path.
+ * @param stats Set to the measurements.
+ */
+void latency_get(enum latency_path path, struct latency_stats* stats);
+
+/**
+ * @brief Estimate a percentile from the histogram.
+ *
+ * @param stats Measurements of a path.
+ * @param pct Percentile (1 - 100).
+ * @return u16 Upper bound of the bin holding the percentile, limited to the
+ * largest time recorded (units of LATENCY_TAG_US).
+ */
+u16 latency_percentile(const struct latency_stats* stats, u8 pct);
+
+/**
+ * @brief Clear the measurements of every path.
+ */
+void latency_reset(void);
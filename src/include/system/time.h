@@ -25,3 +25,12 @@ void systime_start(void);
  * @return u32 Current time in milliseconds.
  */
 u32 systime_ms(void);
+
+/**
+ * @brief Get the system time with microsecond resolution.
+ * Derived from the system timer count, wraps after ~71 minutes so only use
+ * for measuring intervals.
+ *
+ * @return u32 Current time in microseconds.
+ */
+u32 systime_us(void);
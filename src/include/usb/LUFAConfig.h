@@ -66,7 +66,8 @@
 // USB_OPT_AUTO_PLL)
 //		#define USB_STREAM_TIMEOUT_MS            {Insert Value Here}
 #define NO_LIMITED_CONTROLLER_CONNECT
-#define NO_SOF_EVENTS
+#define INTERRUPT_CONTROL_ENDPOINT
+// SOF events are enabled by usb_update() for frame aligned MIDI out
 
 /* USB Device Mode Driver Related Tokens: */
 //		#define USE_RAM_DESCRIPTORS
@@ -19,4 +19,16 @@ int usb_update(void);
 // Function to check if the virtual serial port is active (DTR asserted)
 bool usb_cdc_is_active(void);
 
+// Incremented each time the host selects the configuration (wraps), a change
+// means any state the host had for the device is gone
+u8 usb_session(void);
+
+// True once the host has selected a configuration and usb_update() has set up
+// the endpoints for it, the data endpoints must not be used before
+bool usb_configured(void);
+
+// Number of USB start of frames (wraps), only counts while gCONFIG.midi_tx_sof
+// is set
+u8 usb_sof_count(void);
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -18,7 +18,18 @@
 #define USB_MIDI_STREAM_EPSIZE			64
 #define USB_CDC_NOTIFICATION_EPSIZE 8
 #define USB_CDC_EPSIZE							16
-#define USB_MIDI_POLLING_INTERVAL		0x05
+
+// Endpoint polling interval (ms) reported for the MIDI streaming endpoints,
+// set by the build (see CMakeLists.txt)
+#ifndef USB_MIDI_POLLING_INTERVAL
+#define USB_MIDI_POLLING_INTERVAL 1
+#endif
+
+// Banks per MIDI and CDC data endpoint. 2 is experimental: the LUFA XMEGA
+// endpoint driver enables ping-pong but only programs and polls bank 0.
+#ifndef USB_EP_BANKS
+#define USB_EP_BANKS 1
+#endif
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -0,0 +1,69 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	Response curves map a normalised position (0-0xFFFF) to a normalised
+	output (0-0xFFFF). Each curve is a table of VMAP_CURVE_POINTS equally spaced
+	points and is evaluated with one lookup and a linear interpolation.
+
+	The built-in curves live in flash, the user curves are uploaded over SysEx
+	and are shared by every vmap that selects them.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "system/types.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define VMAP_CURVE_SEG_BITS (12) // Each segment spans 2^12 input steps
+#define VMAP_CURVE_POINTS		((1 << (16 - VMAP_CURVE_SEG_BITS)) + 1)
+#define VMAP_CURVE_USER_NB	(2)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Points of the user curves, shared by all vmaps
+extern u16 gVMAP_USER_CURVES[VMAP_CURVE_USER_NB][VMAP_CURVE_POINTS];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+enum vmap_curve {
+	VMAP_CURVE_LINEAR, // No table, the plan maps directly to the range
+	VMAP_CURVE_LOG,		 // Fast rise, e.g. audio taper for attenuation
+	VMAP_CURVE_EXP,		 // Slow rise, e.g. volume and filter cutoff
+	VMAP_CURVE_S,			 // Smoothstep, fine control at both ends
+
+	VMAP_CURVE_USER_0,
+	VMAP_CURVE_USER_1,
+
+	VMAP_CURVE_NB,
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Reset the user curves to linear.
+ */
+void vmap_curve_init(void);
+
+/**
+ * @brief Evaluate a response curve.
+ *
+ * @param curve The curve (enum vmap_curve), must not be VMAP_CURVE_LINEAR.
+ * @param t Normalised input (0-0xFFFF).
+ * @return u16 Normalised output (0-0xFFFF).
+ */
+u16 vmap_curve_eval(u8 curve, u16 t);
+
+/**
+ * @brief Set a point of a user curve.
+ *
+ * @param user User curve index (0 to VMAP_CURVE_USER_NB - 1).
+ * @param point Point index (0 to VMAP_CURVE_POINTS - 1).
+ * @param value Normalised output at the point (0-0xFFFF).
+ * @return int 0 on success, ERR_BAD_PARAM if an index is out of range.
+ */
+int vmap_curve_set_point(u8 user, u8 point, u16 value);
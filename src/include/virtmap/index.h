@@ -0,0 +1,73 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	Reverse index from an incoming MIDI (channel, CC) to the vmaps that are
+	configured for it, so that feedback from the host does not need to scan
+	every vmap of every bank.
+
+	Every vmap has a small integer id (see virtmap/pool.h), the index is a hash
+	table of id chains keyed on (channel, CC), pitch bend vmaps are keyed on
+	(channel, 0). Lookups walk a single chain and
+	compare against the vmap configuration, so a stale entry can never match.
+
+	The index must be rebuilt with vmap_index_build() after the vmap
+	configurations are (re)loaded or the pool is resized, and
+	vmap_index_update() must be called whenever a single vmap protocol
+	configuration is changed.
+
+	Usage:
+		for (u8 id = vmap_index_find(ch, cc); id != VMAP_ID_NONE;
+				 id = vmap_index_next(id, ch, cc)) {
+			struct encoder* enc;
+			struct virtmap* vmap = vmap_from_id(id, &enc);
+			...
+		}
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "virtmap/pool.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define VMAP_INDEX_BUCKETS (32) // Must be a power of 2
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Rebuild the whole index from the current vmap configurations.
+ */
+void vmap_index_build(void);
+
+/**
+ * @brief Re-index a single vmap after its protocol configuration changed.
+ *
+ * @param id Vmap id.
+ * @return int 0 on success, ERR_BAD_PARAM if the id is invalid.
+ */
+int vmap_index_update(u8 id);
+
+/**
+ * @brief Find the first vmap that is configured for a MIDI channel and CC.
+ *
+ * @param channel MIDI channel (0-15).
+ * @param cc MIDI CC number (0-127).
+ * @return u8 Vmap id, or VMAP_ID_NONE if there is no match.
+ */
+u8 vmap_index_find(u8 channel, u8 cc);
+
+/**
+ * @brief Find the next vmap that is configured for a MIDI channel and CC.
+ *
+ * @param id The previous id returned by vmap_index_find/next.
+ * @param channel MIDI channel (0-15).
+ * @param cc MIDI CC number (0-127).
+ * @return u8 Vmap id, or VMAP_ID_NONE if there are no more matches.
+ */
+u8 vmap_index_next(u8 id, u8 channel, u8 cc);
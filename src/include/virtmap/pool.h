@@ -0,0 +1,102 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	All vmaps live in a single pool of VMAP_POOL_SIZE records. Each encoder
+	owns a contiguous slice of the pool (vmap_base, vmap_count), and the slices
+	are kept packed in bank/encoder order.
+
+	An encoder can have 0 to VMAP_MAX_PER_ENC vmaps, as long as the total fits
+	in the pool. Resizing an encoder moves the slices that follow it, so vmap
+	pointers and ids must not be held across a resize.
+
+	The position of a vmap in the pool is its id (see virtmap/index.h).
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "system/hardware.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define VMAP_ID_NONE (0xFF)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+extern struct virtmap gVMAP_POOL[VMAP_POOL_SIZE];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Give every encoder NUM_VMAPS_PER_ENC default vmaps.
+ */
+void vmap_pool_init(void);
+
+/**
+ * @brief Recompute the slice of every encoder from its vmap_count, used after
+ * the counts are loaded from the config.
+ *
+ * @return int 0 on success, ERR_NO_MEM if the counts do not fit in the pool.
+ */
+int vmap_pool_layout(void);
+
+/**
+ * @brief Change the number of vmaps of an encoder. New vmaps are reset to
+ * unmapped defaults, removed vmaps are discarded.
+ *
+ * @param enc Pointer to the encoder.
+ * @param count New number of vmaps (0 to VMAP_MAX_PER_ENC).
+ * @return int 0 on success, ERR_BAD_PARAM or ERR_NO_MEM on failure.
+ */
+int vmap_pool_resize(struct encoder* enc, u8 count);
+
+/**
+ * @brief Get the number of unallocated vmaps in the pool.
+ */
+u8 vmap_pool_free(void);
+
+/**
+ * @brief Reset a vmap to an unmapped, linear, full range configuration.
+ *
+ * @param vmap Pointer to the vmap.
+ */
+void vmap_reset(struct virtmap* vmap);
+
+/**
+ * @brief Get the id of a vmap.
+ *
+ * @param bank Bank index.
+ * @param enc Encoder index.
+ * @param vmap Vmap index within the encoder.
+ * @return u8 The vmap id, or VMAP_ID_NONE if any index is out of range.
+ */
+u8 vmap_id(u8 bank, u8 enc, u8 vmap);
+
+/**
+ * @brief Get a vmap (and optionally its encoder) from an id.
+ *
+ * @param id Vmap id.
+ * @param enc Set to the owning encoder if not NULL.
+ * @return struct virtmap* The vmap, or NULL if the id is not allocated.
+ */
+struct virtmap* vmap_from_id(u8 id, struct encoder** enc);
+
+/**
+ * @brief Get a vmap of an encoder, the index is not checked.
+ */
+static inline struct virtmap* vmap_get(const struct encoder* enc, u8 idx) {
+	return &gVMAP_POOL[enc->vmap_base + idx];
+}
+
+/**
+ * @brief Get the active vmap of an encoder.
+ *
+ * @return struct virtmap* The vmap, or NULL if the encoder has no vmaps.
+ */
+static inline struct virtmap* vmap_get_active(const struct encoder* enc) {
+	return enc->vmap_count ? vmap_get(enc, enc->vmap_active) : NULL;
+}
@@ -0,0 +1,40 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	Full state snapshot, sends the cached value of every vmap in a bank (or in
+	all banks) so that a host can resync without polling each parameter.
+
+	The snapshot is paced by vmap_snapshot_update(), a few vmaps are sent per
+	main loop pass and only while the MIDI out queue and the transmit ring have
+	room to spare for live encoder movement.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "system/types.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define VMAP_SNAPSHOT_ALL_BANKS (0x7F) // Fits in a sysex data byte
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Start a snapshot, replacing any snapshot in progress.
+ *
+ * @param bank Bank index, or VMAP_SNAPSHOT_ALL_BANKS.
+ * @return int 0 on success, ERR_BAD_PARAM if the bank is invalid.
+ */
+int vmap_snapshot_start(u8 bank);
+
+/**
+ * @brief Send the next batch of a snapshot in progress, call from the main
+ * loop.
+ */
+void vmap_snapshot_update(void);
@@ -11,8 +11,16 @@
 #include "protocol/protocol.h"
 #include "led/rgb.h"
 #include "led/color.h"
+#include "virtmap/curve.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Fractional bits of the high resolution position (see virtmap.curr_frac)
+#define VMAP_POS_FRAC_BITS (8)
+
+// 16-bit high resolution position of a vmap (curr_pos.curr_frac)
+#define VMAP_POS_HR(v)                                                         \
+	(u16)(((u16)(v)->curr_pos << VMAP_POS_FRAC_BITS) | (v)->curr_frac)
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -39,6 +47,33 @@ enum virtmap_display_mode {
 	VIRTMAP_DISPLAY_NB,
 };
 
+enum vmap_plan_kind {
+	VMAP_PLAN_NONE,	 // No output
+	VMAP_PLAN_CC,		 // 7-bit value from the whole position
+	VMAP_PLAN_CC_14, // 14-bit value (CC pair or NRPN/RPN) from the HR position
+	VMAP_PLAN_REL,	 // Relative deltas, accumulated in curr_val
+
+	VMAP_PLAN_NB,
+};
+
+/**
+ * @brief Precomputed output mapping of a vmap, see vmap_compile().
+ *
+ * The output value is base + ((x * scale) >> shift), where x is the offset
+ * of the current position from position.start, so no division is needed when
+ * the encoder moves.
+ *
+ * With a response curve the scale instead normalises x to 0-0xFFFF, and the
+ * curve output is multiplied by range.
+ */
+struct vmap_plan {
+	i16 base;
+	u16 scale;
+	u16 range;
+	u8	shift : 5;
+	u8	kind	: 2;
+};
+
 struct virtmap {
 	/**
 	 * @brief The lower and upper range determine the numerical values that will
@@ -82,9 +117,21 @@ struct virtmap {
 		u8 stop;
 	} position;
 
+	/**
+	 * @brief The current position is an 8.8 fixed point value, curr_pos is the
+	 * whole part and is what the display (and 7-bit outputs) use.
+	 *
+	 * In high resolution mode the fractional movement from the acceleration
+	 * engine accumulates in curr_frac, giving a 16-bit position so that 14-bit
+	 * outputs can use their full range. Otherwise curr_frac is always 0.
+	 */
 	u8							 curr_pos;
-	i16							 curr_val;
+	u8							 curr_frac;
+	bool						 hires;
+	u8							 curve;		 // enum vmap_curve
+	i16							 curr_val; // Output value, or unsent delta if relative
 	struct proto_cfg cfg;
+	struct vmap_plan plan; // Compiled from range, position and cfg
 
 	// Color properties
 	struct hsv_color hsv; // HSV color values for RGB LEDs
@@ -94,3 +141,43 @@ struct virtmap {
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Compile the output plan of a vmap. Must be called whenever the range,
+ * position or protocol configuration of the vmap is changed.
+ *
+ * @param vmap Pointer to the vmap.
+ */
+void vmap_compile(struct virtmap* vmap);
+
+/**
+ * @brief Post the cached output value (curr_val) of a vmap to MIDI out, in the
+ * format of its plan. Relative and unmapped vmaps send nothing.
+ *
+ * @param vmap Pointer to the vmap.
+ * @param stamp Latency tag of the input that moved it (see system/latency.h).
+ */
+void vmap_send(const struct virtmap* vmap, u16 stamp);
+
+/**
+ * @brief Evaluate the compiled plan of a vmap at its current position.
+ *
+ * @param vmap Pointer to the vmap.
+ * @return i16 The output value.
+ */
+static inline i16 vmap_plan_value(const struct virtmap* vmap) {
+	const struct vmap_plan* plan = &vmap->plan;
+
+	u16 x = (plan->kind == VMAP_PLAN_CC_14)
+							? (u16)(VMAP_POS_HR(vmap) -
+											((u16)vmap->position.start << VMAP_POS_FRAC_BITS))
+							: (u16)(vmap->curr_pos - vmap->position.start);
+
+	u32 m = ((u32)x * plan->scale) >> plan->shift;
+
+	if (vmap->curve != VMAP_CURVE_LINEAR) {
+		m = ((u32)vmap_curve_eval(vmap->curve, (u16)m) * plan->range + 0x8000) >> 16;
+	}
+
+	return plan->base + (i16)m;
+}
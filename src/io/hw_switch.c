@@ -18,27 +18,45 @@
 	SIDE_SW2 -> PORTA Pin 1)
 	SIDE_SW1 -> PORTA Pin 2)
 
+	The switches are not polled all the time. Any edge on the side switch pins
+	raises the PORTA INT0 interrupt, which opens a debounce window. The pins are
+	sampled every update while the window is open, and it closes once the
+	minimum window time has passed and every debounce sample agrees.
+
 */
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 
 #include "hal/gpio.h"
 #include "system/hardware.h"
 #include "console/console.h"
+#include "system/time.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-#define PORT_SW (PORTA) // IO port for side-switches
+#define PORT_SW						(PORTA) // IO port for side-switches
+#define SW_PIN_MASK				((1u << NUM_SIDE_SWITCHES) - 1)
+#define SW_DEBOUNCE_TIME	(5) // Minimum debounce window (ms)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool debounce_settled(void);
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 static struct switch_x8_ctx switch_ctx;
 
+// Set by the pin change interrupt, start with the window open to sample the
+// initial switch states.
+static volatile bool sw_activity = true;
+static bool					 debounce_active;
+static u32					 debounce_start;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void hw_switch_init(void) {
@@ -46,10 +64,30 @@ void hw_switch_init(void) {
 	for (u8 i = 0; i < NUM_SIDE_SWITCHES; ++i) {
 		gpio_dir(&PORT_SW, i, GPIO_INPUT);
 		gpio_mode(&PORT_SW, i, PORT_OPC_PULLUP_gc);
+		gpio_sense(&PORT_SW, i, PORT_ISC_BOTHEDGES_gc);
 	}
+
+	// Pin change interrupt on any side switch
+	PORT_SW.INT0MASK = SW_PIN_MASK;
+	PORT_SW.INTFLAGS = PORT_INT0IF_bm;
+	PORT_SW.INTCTRL	 = (PORT_SW.INTCTRL & ~PORT_INT0LVL_gm) | PORT_INT0LVL_LO_gc;
 }
 
 void hw_switch_update(void) {
+	if (sw_activity) {
+		sw_activity			= false;
+		debounce_active = true;
+		debounce_start	= systime_ms();
+	}
+
+	if (!debounce_active) {
+		// Clear the edges reported by the final debounce pass
+		if (switch_ctx.raw) {
+			switch_x8_debounce(&switch_ctx);
+		}
+		return;
+	}
+
 	// Read the GPIO states for all side switches
 	u8 switch_states = 0;
 
@@ -63,6 +101,11 @@ void hw_switch_update(void) {
 
 	// Update the switch context with the new GPIO states
 	switch_x8_update(&switch_ctx, switch_states);
+
+	if ((systime_ms() - debounce_start) >= SW_DEBOUNCE_TIME &&
+			debounce_settled()) {
+		debounce_active = false;
+	}
 }
 
 enum switch_state hw_side_switch_state(u8 idx) {
@@ -78,3 +121,18 @@ enum switch_state hw_side_switch_state(u8 idx) {
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// True when every sample in the debounce buffer holds the same states
+static bool debounce_settled(void) {
+	for (int i = 1; i < SWITCH_DEBOUNCE_SAMPLES; i++) {
+		if (switch_ctx.buf[i] != switch_ctx.buf[0]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+ISR(PORTA_INT0_vect) {
+	sw_activity = true;
+}
@@ -10,6 +10,7 @@
 
 #include "system/config.h"
 #include "system/error.h"
+#include "system/latency.h"
 #include "system/print.h"
 #include "system/time.h"
 #include "io/encoder.h"
@@ -20,18 +21,34 @@
 #include "event/animation.h" // Add animation event header
 
 #include "system/hardware.h"
+#include "led/led.h"
+#include "virtmap/index.h"
+#include "virtmap/pool.h"
+#include "virtmap/snapshot.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define REL_CC_MAX_DELTA (63)			// Largest delta in one relative CC
+#define REL_ACC_MAX			 (0x1FFF) // Limit of the unsent relative delta
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 static void sw_encoder_init(void);
 static void sw_encoder_update(void);
+static void sw_encoder_expire(void);
 static void sw_side_switch_init(void);
 static void sw_side_switch_update(void);
 static void vmap_update(struct encoder* enc, struct virtmap* map);
+static void vmap_cycle(struct encoder* enc);
+static void vmap_reset_pos(struct virtmap* vmap);
+static bool enc_playing_dead(const struct encoder* enc, u32 now);
+static void vmap_rel_flush(void);
+static u8		rel_cc_encode(u8 mode, i8 delta);
 static int	midi_in_handler(void* evt);
+static void midi_feedback(u8 channel, u8 key, u8 type, u16 value, u16 stamp);
+static void feedback_redraw(struct encoder* enc, const struct virtmap* vmap,
+														u16 stamp);
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -46,8 +63,10 @@ struct side_switch gSIDE_SWITCHES[NUM_SIDE_SWITCHES];
 void input_init(void) {
 	hw_encoder_init();
 	hw_switch_init();
+	vmap_curve_init();
 	sw_encoder_init();
 	sw_side_switch_init();
+	vmap_index_build();
 	event_channel_subscribe(EVENT_CHANNEL_MIDI_IN, &evt_midi);
 }
 
@@ -55,6 +74,7 @@ void input_update(void) {
 	hw_encoder_scan();
 	hw_switch_update();
 	sw_encoder_update();
+	sw_encoder_expire();
 	sw_side_switch_update();
 }
 
@@ -68,6 +88,8 @@ bool is_reset_pressed(void) {
 static void sw_encoder_init(void) {
 	// Initialise encoder devices and virtual parameter mappings
 	enum midi_cc cc = MIDI_CC_MIN;
+	vmap_pool_init();
+
 	for (uint b = 0; b < NUM_ENC_BANKS; b++) {
 		for (uint e = 0; e < NUM_ENCODERS; e++) {
 			struct encoder* enc = &gENCODERS[b][e];
@@ -102,8 +124,8 @@ static void sw_encoder_init(void) {
 				enc->display.mode = DIS_MODE_MULTI;
 			}
 
-			for (uint v = 0; v < NUM_VMAPS_PER_ENC; v++) {
-				struct virtmap* map		= &enc->vmaps[v];
+			for (uint v = 0; v < enc->vmap_count; v++) {
+				struct virtmap* map		= vmap_get(enc, v);
 				map->position.start		= ENC_MIN;
 				map->position.stop		= ENC_MAX;
 				map->range.lower			= MIDI_CC_MIN;
@@ -112,6 +134,9 @@ static void sw_encoder_init(void) {
 				map->cfg.type					= PROTOCOL_MIDI;
 				map->cfg.midi.channel = 0;
 				map->cfg.midi.cc			= cc++;
+				map->hires						= false;
+				map->curve						= VMAP_CURVE_LINEAR;
+				vmap_compile(map);
 
 				// Set initial HSV values based on encoder index
 				// This will create a nice color gradient across encoders
@@ -162,7 +187,7 @@ static void sw_encoder_update(void) {
 				}
 
 				case SW_MODE_VMAP_CYCLE: {
-					enc->vmap_active = (enc->vmap_active + 1) % NUM_VMAPS_PER_ENC;
+					vmap_cycle(enc);
 					mf_draw_encoder(enc);
 					break;
 				}
@@ -173,7 +198,7 @@ static void sw_encoder_update(void) {
 				}
 
 				case SW_MODE_RESET_ON_PRESS: {
-					enc->vmaps[enc->vmap_active].curr_pos = 0;
+					vmap_reset_pos(vmap_get_active(enc));
 					break;
 				}
 
@@ -213,7 +238,7 @@ static void sw_encoder_update(void) {
 				}
 
 				case SW_MODE_RESET_ON_RELEASE: {
-					enc->vmaps[enc->vmap_active].curr_pos = 0;
+					vmap_reset_pos(vmap_get_active(enc));
 					break;
 				}
 
@@ -231,17 +256,20 @@ static void sw_encoder_update(void) {
 		}
 
 		int	 dir	 = quadrature_direction(enc->quad_ctx);
-		bool moved = encoder_movement_update(&enc->enc_ctx, dir);
+		bool moved = encoder_movement_update(&enc->enc_ctx, dir,
+																				 enc->quad_ctx->detent_time);
 
 		if (!moved) {
 			continue;
 		}
 
-		if (enc->vmap_mode == VIRTMAP_MODE_TOGGLE) {
-			vmap_update(enc, &enc->vmaps[enc->vmap_active]);
+		if (enc->vmap_count == 0) {
+			continue;
+		} else if (enc->vmap_mode == VIRTMAP_MODE_TOGGLE) {
+			vmap_update(enc, vmap_get_active(enc));
 		} else {
-			for (uint v = 0; v < NUM_VMAPS_PER_ENC; v++) {
-				vmap_update(enc, &enc->vmaps[v]);
+			for (uint v = 0; v < enc->vmap_count; v++) {
+				vmap_update(enc, vmap_get(enc, v));
 			}
 		}
 
@@ -256,143 +284,287 @@ static void sw_encoder_update(void) {
 			enc->update_display = systime_ms();
 		}
 	}
+
+	vmap_rel_flush();
+}
+
+/*
+	Expire the detent time of one encoder per pass, across every bank. Encoders
+	outside the current bank are not scanned, so this keeps the time of their
+	last detent from aliasing after the us timer wraps.
+*/
+static void sw_encoder_expire(void) {
+	static u8				next = 0;
+	struct encoder* enc	 = &gENCODERS[next / NUM_ENCODERS][next % NUM_ENCODERS];
+
+	encoder_movement_expire(&enc->enc_ctx, systime_us());
+
+	if (++next >= NUM_ENC_BANKS * NUM_ENCODERS) {
+		next = 0;
+	}
 }
 
 static void vmap_update(struct encoder* enc, struct virtmap* vmap) {
-	i16 newpos = vmap->curr_pos + enc->enc_ctx.velocity;
-	newpos		 = CLAMP(newpos, ENC_MIN, ENC_MAX);
-	newpos		 = CLAMP(newpos, vmap->position.start, vmap->position.stop);
+	STATIC_ASSERT(VMAP_POS_FRAC_BITS == ENC_ACCEL_FRAC_BITS,
+								"vmap and acceleration fixed point formats must match");
+
+	// High resolution vmaps take the unrounded movement, otherwise whole steps
+	i32 delta = vmap->hires
+									? enc->enc_ctx.delta
+									: ((i32)enc->enc_ctx.velocity << VMAP_POS_FRAC_BITS);
+
+	if (vmap->plan.kind == VMAP_PLAN_REL) {
+		// Summed until the next output tick, see vmap_rel_flush()
+		vmap->curr_val = (i16)CLAMP(vmap->curr_val + enc->enc_ctx.velocity,
+																-REL_ACC_MAX, REL_ACC_MAX);
+	}
+
+	i32 pos		 = VMAP_POS_HR(vmap);
+	i32 newpos = pos + delta;
+	newpos		 = CLAMP(newpos, (i32)vmap->position.start << VMAP_POS_FRAC_BITS,
+										 (i32)vmap->position.stop << VMAP_POS_FRAC_BITS);
 
-	if ((vmap->curr_pos == newpos) ||
-			!(IN_RANGE(newpos, vmap->position.start, vmap->position.stop))) {
+	if (pos == newpos) {
 		return;
 	}
 
-	vmap->curr_pos = (u8)newpos;
+	vmap->curr_pos	= (u8)(newpos >> VMAP_POS_FRAC_BITS);
+	vmap->curr_frac = (u8)newpos;
 
-	switch (vmap->cfg.type) {
+	// The plan kind encodes the protocol and mode, see vmap_compile()
+	switch (vmap->plan.kind) {
+		case VMAP_PLAN_CC:
+		case VMAP_PLAN_CC_14: {
+			i16 val = vmap_plan_value(vmap);
 
-		case PROTOCOL_MIDI: {
-			switch (vmap->cfg.midi.mode) {
-				case MIDI_MODE_DISABLED: {
-					break;
-				}
+			if (vmap->curr_val == val) {
+				break;
+			}
 
-				case MIDI_MODE_CC: {
-					bool invert = (vmap->range.lower > vmap->range.upper);
+			vmap->curr_val = val;
+			vmap_send(vmap, latency_tag(enc->quad_ctx->detent_time));
+			break;
+		}
 
-					i16 val = convert_range_i16(vmap->curr_pos, vmap->position.start,
-																			vmap->position.stop, vmap->range.lower,
-																			vmap->range.upper);
+		case VMAP_PLAN_REL:
+		case VMAP_PLAN_NONE:
+		default: break;
+	}
+}
 
-					if (invert) {
-						val = MIDI_CC_MAX - val;
-					}
+// Select the next vmap of an encoder, wrapping to the first
+static void vmap_cycle(struct encoder* enc) {
+	if (enc->vmap_count == 0) {
+		return;
+	}
 
-					if (vmap->curr_val == val) {
-						break;
-					}
+	enc->vmap_active = (enc->vmap_active + 1) % enc->vmap_count;
+}
 
-					vmap->curr_val = val;
+static void vmap_reset_pos(struct virtmap* vmap) {
+	if (vmap == NULL) {
+		return;
+	}
 
-					midi_event_s midi_evt;
-					midi_evt.type						 = MIDI_EVENT_CC;
-					midi_evt.data.cc.channel = vmap->cfg.midi.channel;
-					midi_evt.data.cc.control = vmap->cfg.midi.cc;
-					midi_evt.data.cc.value	 = val & MIDI_CC_MAX;
-					event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
-					break;
-				}
+	vmap->curr_pos	= 0;
+	vmap->curr_frac = 0;
+}
 
-				case MIDI_MODE_CC_14: {
-					bool invert = (vmap->range.lower > vmap->range.upper);
+/*
+	Relative vmaps accumulate their movement in curr_val, once per output tick
+	(gCONFIG.midi_throttle_time) the summed delta is sent as a single CC. Deltas
+	larger than one message can carry are sent over the following ticks. If the
+	MIDI out queue fills, the delta stays in curr_val and the flush resumes from
+	that vmap on the next pass.
+*/
+static void vmap_rel_flush(void) {
+	static u32 last_tick = 0;
+	static u8	 resume		 = VMAP_ID_NONE; // First vmap of an unfinished flush
+	u32				 now			 = systime_ms();
+	u8				 first		 = resume;
+
+	if (first == VMAP_ID_NONE) {
+		if ((now - last_tick) < gCONFIG.midi_throttle_time) {
+			return;
+		}
+		last_tick = now;
+		first			= 0;
+	}
 
-					i16 val = convert_range_i16(vmap->curr_pos, vmap->position.start,
-																			vmap->position.stop, vmap->range.lower,
-																			vmap->range.upper);
+	u8 used = VMAP_POOL_SIZE - vmap_pool_free();
+	for (u8 id = first; id < used; id++) {
+		struct virtmap* vmap = &gVMAP_POOL[id];
 
-					if (invert) {
-						val = 0x3FFF - val;
-					}
+		if (vmap->plan.kind != VMAP_PLAN_REL || vmap->curr_val == 0) {
+			continue;
+		}
 
-					if (vmap->curr_val == val) {
-						break;
-					}
+		i8 delta = (i8)CLAMP(vmap->curr_val, -REL_CC_MAX_DELTA, REL_CC_MAX_DELTA);
 
-					vmap->curr_val = val;
+		midi_event_s midi_evt;
+		midi_evt.type						 = MIDI_EVENT_CC_REL;
+		midi_evt.stamp					 = LATENCY_TAG_NONE; // Delayed by design
+		midi_evt.data.cc.channel = vmap->cfg.midi.channel;
+		midi_evt.data.cc.control = vmap->cfg.midi.cc;
+		midi_evt.data.cc.value	 = rel_cc_encode(vmap->cfg.midi.mode, delta);
 
-					midi_event_s midi_evt;
-					// Send the MSB
-					midi_evt.type						 = MIDI_EVENT_CC;
-					midi_evt.data.cc.channel = vmap->cfg.midi.channel;
-					midi_evt.data.cc.control = vmap->cfg.midi.cc;
-					midi_evt.data.cc.value	 = (val >> 7) & 0x7F;
-					event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
+		if (event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt) != 0) {
+			resume = id;
+			return;
+		}
 
-					// Then the LSB
-					midi_evt.data.cc.control = (u8)vmap->cfg.midi.cc + 32;
-					midi_evt.data.cc.value	 = val & 0x7F;
-					event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
-					break;
-				}
+		vmap->curr_val -= delta;
+	}
 
-				case MIDI_MODE_REL_CC: {
-					break;
-				}
-				case MIDI_MODE_NOTE: {
-					break;
-				}
-			}
+	resume = VMAP_ID_NONE;
+}
+
+// Encode a delta (-63 to 63) as a relative CC value
+static u8 rel_cc_encode(u8 mode, i8 delta) {
+	switch (mode) {
+		case MIDI_MODE_REL_CC_OFFSET: return (u8)(64 + delta);
+		case MIDI_MODE_REL_CC_SIGN_MAG:
+			return (delta < 0) ? (u8)(0x40 | -delta) : (u8)delta;
+		case MIDI_MODE_REL_CC:
+		default: return (u8)delta & MIDI_CC_MAX;
+	}
+}
+
+/*
+	An encoder "plays dead" to incoming feedback for gCONFIG.enc_dead_time ms
+	after its last detent, so host echoes cannot fight the local movement. Only
+	the time is used, encoders outside the current bank keep a stale velocity.
+	The time is ignored once it is no longer recent, as it may have wrapped.
+*/
+static bool enc_playing_dead(const struct encoder* enc, u32 now) {
+	STATIC_ASSERT((u32)UINT8_MAX * 1000 < ENC_RECENT_TIME,
+								"The dead time must end while the detent is recent");
+
+	u32 elapsed = now - enc->enc_ctx.last_detent_time;
+	return enc->enc_ctx.recent && elapsed < (u32)gCONFIG.enc_dead_time * 1000;
+}
 
+static int midi_in_handler(void* evt) {
+	midi_event_s* midi = (midi_event_s*)evt;
+
+	switch (midi->type) {
+		case MIDI_EVENT_CC:
+			midi_feedback(midi->data.cc.channel, midi->data.cc.control, midi->type,
+										midi->data.cc.value, midi->stamp);
 			break;
-		}
 
-		case PROTOCOL_OSC: {
+		case MIDI_EVENT_NOTE_ON:
+		case MIDI_EVENT_NOTE_OFF:
+			midi_feedback(midi->data.note.channel, midi->data.note.note, midi->type,
+										midi->data.note.value, midi->stamp);
+			break;
+
+		case MIDI_EVENT_PITCH_BEND:
+			midi_feedback(midi->data.bend.channel, 0, midi->type,
+										midi->data.bend.value, midi->stamp);
 			break;
-		}
 
-		case PROTOCOL_NONE:
 		default: break;
 	}
+
+	return 0;
 }
 
-static int midi_in_handler(void* evt) {
-	midi_event_s* midi = (midi_event_s*)evt;
+/*
+	Move every vmap that follows a received message to the received value. Only
+	vmaps whose mode sends that message type follow it, relative controls have
+	no absolute value and parameter vmaps only share the LSB of their number
+	with the CC.
+*/
+static void midi_feedback(u8 channel, u8 key, u8 type, u16 value, u16 stamp) {
+	u32 now = systime_us();
+
+	for (u8 id = vmap_index_find(channel, key); id != VMAP_ID_NONE;
+			 id = vmap_index_next(id, channel, key)) {
+		struct encoder* enc;
+		struct virtmap* vmap = vmap_from_id(id, &enc);
+		u8							mode = vmap->cfg.midi.mode;
+
+		// Discard feedback (usually our own echo) while the user is turning.
+		if (enc_playing_dead(enc, now)) {
+			continue;
+		}
 
-	switch (midi->type) {
-		case MIDI_EVENT_CC: {
-			for (uint b = 0; b < NUM_ENC_BANKS; b++) {
-				for (uint e = 0; e < NUM_ENCODERS; e++) {
-					struct encoder* enc = &gENCODERS[b][e];
-
-					for (int v = 0; v < NUM_VMAPS_PER_ENC; v++) {
-						struct virtmap* vmap = &enc->vmaps[v];
-						if (vmap->cfg.type != PROTOCOL_MIDI) {
-							continue;
-						} else if (vmap->cfg.midi.channel != midi->data.cc.channel) {
-							continue;
-						} else if (vmap->cfg.midi.cc != midi->data.cc.control) {
-							continue;
-						}
-
-						// do not update if the encoder is moving.
-						if (enc->enc_ctx.velocity != 0) {
-							continue;
-						}
-						u16 newpos = (u16)convert_range_i16(
-								midi->data.cc.value, vmap->range.lower, vmap->range.upper,
-								vmap->position.start, vmap->position.stop);
-
-						vmap->curr_pos = newpos;
-					}
+		switch (type) {
+			case MIDI_EVENT_CC:
+				if (mode != MIDI_MODE_CC && mode != MIDI_MODE_CC_14) {
+					continue;
 				}
+				break;
+
+			case MIDI_EVENT_NOTE_ON:
+			case MIDI_EVENT_NOTE_OFF:
+				if (mode != MIDI_MODE_NOTE) {
+					continue;
+				}
+				// A released note returns the control to the bottom of its range
+				if (type == MIDI_EVENT_NOTE_OFF) {
+					value = vmap->range.lower;
+				}
+				break;
+
+			case MIDI_EVENT_PITCH_BEND: {
+				if (mode != MIDI_MODE_PITCH_BEND) {
+					continue;
+				}
+
+				// Scale the 14-bit value onto the high resolution position
+				i32 lo14 = (i32)vmap->range.lower << 7;
+				i32 hi14 = (i32)vmap->range.upper << 7;
+				if (hi14 >= lo14) {
+					hi14 |= 0x7F;
+				} else {
+					lo14 |= 0x7F;
+				}
+
+				u16 hr = (u16)convert_range_i32(
+						CLAMP((i32)value, MIN(lo14, hi14), MAX(lo14, hi14)), lo14, hi14,
+						(i32)vmap->position.start << VMAP_POS_FRAC_BITS,
+						(i32)vmap->position.stop << VMAP_POS_FRAC_BITS);
+
+				vmap->curr_pos	= (u8)(hr >> VMAP_POS_FRAC_BITS);
+				vmap->curr_frac = (u8)hr;
+				vmap->curr_val	= vmap_plan_value(vmap);
+				feedback_redraw(enc, vmap, stamp);
+				continue;
 			}
 
-			break;
+			default: continue;
 		}
+
+		u16 newpos = (u16)convert_range_i16(value, vmap->range.lower,
+																				vmap->range.upper, vmap->position.start,
+																				vmap->position.stop);
+
+		vmap->curr_pos	= newpos;
+		vmap->curr_frac = 0;
+
+		// The host now has this value, keep the cache in step with it
+		if (vmap->plan.kind == VMAP_PLAN_CC ||
+				vmap->plan.kind == VMAP_PLAN_CC_14) {
+			vmap->curr_val = vmap_plan_value(vmap);
+		}
+
+		feedback_redraw(enc, vmap, stamp);
+	}
+}
+
+// Redraw an encoder of the current bank that shows a vmap moved by feedback
+static void feedback_redraw(struct encoder* enc, const struct virtmap* vmap,
+														u16 stamp) {
+	if (enc != &gENCODERS[gRT.curr_bank][enc->idx] ||
+			vmap != vmap_get_active(enc)) {
+		return;
 	}
 
-	return 0;
+	// Bursts of feedback are drawn once per refresh, not once per message
+	display_mark_dirty(enc->idx);
+	latency_led_pending(enc->idx, stamp);
 }
 
 static void sw_side_switch_init(void) {
@@ -425,7 +597,7 @@ static void sw_side_switch_update(void) {
 					// Cycle vmaps on all encoders
 					for (u8 e = 0; e < NUM_ENCODERS; e++) {
 						struct encoder* enc = &gENCODERS[gRT.curr_bank][e];
-						enc->vmap_active		= (enc->vmap_active + 1) % NUM_VMAPS_PER_ENC;
+						vmap_cycle(enc);
 						mf_draw_encoder(enc);
 					}
 					break;
@@ -435,7 +607,7 @@ static void sw_side_switch_update(void) {
 					for (u8 e = 0; e < NUM_ENCODERS; e++) {
 						struct encoder* enc = &gENCODERS[gRT.curr_bank][e];
 						gSIDE_SWITCHES[i].prev_vmap_active[e] = enc->vmap_active;
-						enc->vmap_active = (enc->vmap_active + 1) % NUM_VMAPS_PER_ENC;
+						vmap_cycle(enc);
 						mf_draw_encoder(enc);
 					}
 					break;
@@ -453,6 +625,8 @@ static void sw_side_switch_update(void) {
 					anim_evt.data.bank_change.prev_bank = (gRT.curr_bank + 1) % NUM_ENC_BANKS;
 					anim_evt.data.bank_change.new_bank = gRT.curr_bank;
 					event_post(EVENT_CHANNEL_ANIMATION, &anim_evt);
+					// Resync the host with the values of the new bank
+					vmap_snapshot_start(gRT.curr_bank);
 					// Update all encoders for the new bank
 					for (u8 e = 0; e < NUM_ENCODERS; e++) {
 						struct encoder* enc = &gENCODERS[gRT.curr_bank][e];
@@ -470,6 +644,8 @@ static void sw_side_switch_update(void) {
 					anim_evt.data.bank_change.prev_bank = (gRT.curr_bank - 1 + NUM_ENC_BANKS) % NUM_ENC_BANKS;
 					anim_evt.data.bank_change.new_bank = gRT.curr_bank;
 					event_post(EVENT_CHANNEL_ANIMATION, &anim_evt);
+					// Resync the host with the values of the new bank
+					vmap_snapshot_start(gRT.curr_bank);
 					// Update all encoders for the new bank
 					for (u8 e = 0; e < NUM_ENCODERS; e++) {
 						struct encoder* enc = &gENCODERS[gRT.curr_bank][e];
@@ -487,8 +663,9 @@ static void sw_side_switch_update(void) {
 				case SIDE_SW_MODE_ALL_VMAP_HOLD:
 					// Restore original vmap for each encoder
 					for (u8 e = 0; e < NUM_ENCODERS; e++) {
-						struct encoder* enc = &gENCODERS[gRT.curr_bank][e];
-						enc->vmap_active		= gSIDE_SWITCHES[i].prev_vmap_active[e];
+						struct encoder* enc	 = &gENCODERS[gRT.curr_bank][e];
+						u8							prev = gSIDE_SWITCHES[i].prev_vmap_active[e];
+						enc->vmap_active		 = (prev < enc->vmap_count) ? prev : 0;
 						mf_draw_encoder(enc);
 					}
 					break;
@@ -23,6 +23,7 @@
 #include "led/color.h"
 #include "led/hsv2rgb.h"
 #include "io/encoder.h"
+#include "virtmap/pool.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -301,14 +302,8 @@ void color_print_gamma_lut(char channel) {
  */
 static struct virtmap* get_virtmap_from_indices(uint8_t bank, uint8_t enc,
 																								uint8_t vmap_idx) {
-	// Check if indices are within valid range
-	if (bank >= NUM_ENC_BANKS || enc >= NUM_ENCODERS ||
-			vmap_idx >= NUM_VMAPS_PER_ENC) {
-		return NULL;
-	}
-
-	// Return pointer to the virtmap
-	return &gENCODERS[bank][enc].vmaps[vmap_idx];
+	// Invalid indices return VMAP_ID_NONE, and therefore NULL
+	return vmap_from_id(vmap_id(bank, enc, vmap_idx), NULL);
 }
 
 /**
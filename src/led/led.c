@@ -16,9 +16,11 @@
 #include "system/config.h"
 #include "system/error.h"
 #include "system/hardware.h"
+#include "system/latency.h"
 #include "system/time.h"
 #include "system/utility.h"
 #include "event/animation.h"  // Include animation header
+#include "virtmap/pool.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -27,6 +29,8 @@
 #define CENTER_INDICATOR_MASK                                                  \
 	INDICATOR_MASK(CENTER_INDICATOR) // Explicit mask for center
 
+#define REFRESH_MS (500 / NUM_PWM_FRAMES) // Shortest time between redraws
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 // Original union structure (used implicitly for bit positions)
@@ -54,6 +58,13 @@ typedef union {
 
 /* ~~~~~~~~~~~~~~~~~~~~ Precomputed Lookup Tables (LUTs) ~~~~~~~~~~~~~~~~~~~ */
 
+// Drawn for encoders without vmaps, position 0 and all colours off
+static const struct virtmap unmapped;
+
+// Encoders marked by display_mark_dirty(), one bit per encoder
+static u16 dirty;
+STATIC_ASSERT(NUM_ENCODERS <= 16, "dirty has one bit per encoder");
+
 // LUT for individual indicator masks (index 0 unused)
 static const u16 INDICATOR_MASKS[NUM_INDICATOR_LEDS + 1] = {
 		0, // Index 0 unused
@@ -115,7 +126,8 @@ int display_init(void) {
 }
 
 void display_update(void) {
-	u32 time_now = systime_ms();
+	static u32 last_refresh = 0;
+	u32				 time_now			= systime_ms();
 
 	// Check if an animation is active and has priority
 	if (animation_is_active()) {
@@ -130,17 +142,29 @@ void display_update(void) {
 	}
 
 	// Normal display update when no animation is active
+	bool refresh = (time_now - last_refresh) > REFRESH_MS;
+	if (refresh) {
+		last_refresh = time_now;
+	}
+
 	for (int e = 0; e < NUM_ENCODERS; e++) {
-		struct encoder* enc = &gENCODERS[gRT.curr_bank][e];
+		struct encoder* enc		= &gENCODERS[gRT.curr_bank][e];
+		bool						marked = refresh && (dirty & (1U << e));
 
-		if (enc->update_display != 0 &&
-				(time_now - enc->update_display) > (500 / NUM_PWM_FRAMES)) {
+		if (marked || (enc->update_display != 0 &&
+									 (time_now - enc->update_display) > REFRESH_MS)) {
 			mf_draw_encoder(enc);
 			enc->update_display = 0;
 		}
 	}
 }
 
+void display_mark_dirty(u8 enc_idx) {
+	if (enc_idx < NUM_ENCODERS) {
+		dirty |= (1U << enc_idx);
+	}
+}
+
 /**
  * @brief Draws the LED state for a given encoder. Highly optimized using LUTs.
  * @param enc Pointer to the encoder structure.
@@ -152,7 +176,11 @@ int mf_draw_encoder(struct encoder* enc) {
 	assert(NUM_INDICATOR_LEDS == 11); // LUTs assume this size
 
 	// --- 1. Fetch frequently used data ---
-	struct virtmap*					vmap				= &enc->vmaps[enc->vmap_active];
+	const struct virtmap*		vmap				= vmap_get_active(enc);
+	if (vmap == NULL) {
+		vmap = &unmapped;
+	}
+
 	const u8								current_pos = vmap->curr_pos;
 	const enum display_mode mode				= enc->display.mode;
 	const bool							is_detent		= enc->detent;
@@ -289,5 +317,11 @@ int mf_draw_encoder(struct encoder* enc) {
 		gFRAME_BUFFER[f][enc_idx] = ~final_state;
 	}
 
+	// --- 7. Any redraw satisfies a pending feedback redraw ---
+	if (enc == &gENCODERS[gRT.curr_bank][enc_idx]) {
+		dirty &= ~(1U << enc_idx);
+		latency_led_drawn(enc_idx);
+	}
+
 	return 0; // Success
 }
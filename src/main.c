@@ -16,11 +16,13 @@
 #include "led/led.h"
 #include "midi/midi.h"
 #include "midi/sysex.h"
+#include "midi/tx_ring.h"
 #include "system/hardware.h"
 #include "system/print.h"
 #include "system/rng.h"
 #include "system/time.h"
 #include "usb/usb.h"
+#include "virtmap/snapshot.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -35,6 +37,8 @@ struct mf_rt gRT = {
 struct sys_config gCONFIG = {
 		.enc_dead_time			= DEFAULT_ENC_PLAYDEAD_TIME,
 		.midi_throttle_time = DEFAULT_MIDI_THROTTLE_TIME,
+		.midi_tx_policy			= DEFAULT_MIDI_TX_POLICY,
+		.midi_tx_sof				= DEFAULT_MIDI_TX_SOF,
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -83,6 +87,7 @@ __attribute__((noreturn)) void main(void) {
 
 	while (1) {
 		input_update();
+		vmap_snapshot_update();
 		event_update();
 		display_update();
 		midi_update();
@@ -0,0 +1,171 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "midi/clock.h"
+#include "midi/midi_types.h"
+#include "system/utility.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Tick periods that are accepted, 300 to 20 BPM
+#define TICK_MIN_US (2500000UL / 300)
+#define TICK_MAX_US (2500000UL / 20)
+
+// The clock is lost if no tick arrives for this long
+#define CLOCK_TIMEOUT_US (4 * TICK_MAX_US)
+
+#define PERIOD_FRAC_BITS (8) // The period is kept in 1/256 us
+
+// PLL gains, as divisors of the tick error
+#define PHASE_DIV (2)
+#define FREQ_DIV	(16)
+
+#define TICKS_PER_SPP (6) // Song position is counted in 16th notes
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+enum clock_lock {
+	CLOCK_IDLE,		 // No ticks
+	CLOCK_ACQUIRE, // One tick, waiting for a second to measure the period
+	CLOCK_LOCKED,
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void clock_tick(u32 now_us);
+static void clock_track(u32 now_us);
+static void clock_timeout(u32 now_us);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static u8	 lock;
+static u32 period_q8; // Tick period
+static u32 next_us;		// Predicted time of the next tick
+static u32 last_us;		// Time the last tick was received
+
+static bool running;
+static bool pending; // The next tick plays the current position, not the next
+static u8		tick;		 // Tick within the beat
+static u32	beat;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool midi_clock_rx(const midi_system_event_s* msg, u32 now_us) {
+	switch (msg->status) {
+		case MIDI_STATUS_TIMING_CLOCK: clock_tick(now_us); return true;
+
+		case MIDI_STATUS_START:
+			running = true;
+			pending = true;
+			tick		= 0;
+			beat		= 0;
+			return true;
+
+		case MIDI_STATUS_CONTINUE: running = true; return true;
+
+		case MIDI_STATUS_STOP: running = false; return true;
+
+		case MIDI_STATUS_SONG_POSITION_POINTER: {
+			u16 spp = (msg->data[0] & 0x7F) | ((u16)(msg->data[1] & 0x7F) << 7);
+			u8	per_beat = MIDI_CLOCK_PPQN / TICKS_PER_SPP;
+
+			pending = true;
+			tick		= (spp % per_beat) * TICKS_PER_SPP;
+			beat		= spp / per_beat;
+			return true;
+		}
+
+		default: return false;
+	}
+}
+
+bool midi_clock_get(struct midi_clock_info* info, u32 now_us) {
+	clock_timeout(now_us);
+
+	if (lock != CLOCK_LOCKED) {
+		return false;
+	}
+
+	// Interpolate between ticks, from the PLL estimate of the last tick
+	u32 period	= period_q8 >> PERIOD_FRAC_BITS;
+	i32 elapsed = (i32)(now_us - (next_us - period));
+	elapsed			= CLAMP(elapsed, 0, (i32)period);
+
+	u32 frac = MIN(((u32)elapsed << 8) / period, 0xFF);
+	u32 pos	 = ((u32)tick << 8) | frac;
+
+	info->running = running;
+	info->bpm_x10 = (u16)(400000000UL / (period_q8 >> 4));
+	info->beat		= beat;
+	info->phase		= (u16)((pos << 16) / ((u32)MIDI_CLOCK_PPQN << 8));
+	return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void clock_tick(u32 now_us) {
+	clock_timeout(now_us);
+	clock_track(now_us);
+	last_us = now_us;
+
+	// The position only moves while playing
+	if (!running) {
+		return;
+	}
+
+	if (pending) {
+		pending = false;
+	} else if (++tick >= MIDI_CLOCK_PPQN) {
+		tick = 0;
+		beat++;
+	}
+}
+
+static void clock_track(u32 now_us) {
+	switch (lock) {
+		case CLOCK_IDLE: lock = CLOCK_ACQUIRE; break;
+
+		case CLOCK_ACQUIRE: {
+			// Packets read in the same pass arrive together, wait for a sane gap
+			u32 interval = now_us - last_us;
+			if (interval >= TICK_MIN_US && interval <= TICK_MAX_US) {
+				period_q8 = interval << PERIOD_FRAC_BITS;
+				next_us		= now_us + interval;
+				lock			= CLOCK_LOCKED;
+			}
+			break;
+		}
+
+		case CLOCK_LOCKED: {
+			i32 period = (i32)(period_q8 >> PERIOD_FRAC_BITS);
+			i32 err		 = (i32)(now_us - next_us);
+
+			// A dropped tick or a tempo jump, measure the period again
+			if (err > (period / 2) || err < -(period / 2)) {
+				lock = CLOCK_ACQUIRE;
+				break;
+			}
+
+			i32 p = (i32)period_q8 + (err * ((1 << PERIOD_FRAC_BITS) / FREQ_DIV));
+			period_q8 = (u32)CLAMP(p, (i32)(TICK_MIN_US << PERIOD_FRAC_BITS),
+														 (i32)(TICK_MAX_US << PERIOD_FRAC_BITS));
+			next_us += (period_q8 >> PERIOD_FRAC_BITS) + (err / PHASE_DIV);
+			break;
+		}
+
+		default: break;
+	}
+}
+
+static void clock_timeout(u32 now_us) {
+	if (lock != CLOCK_IDLE && (i32)(now_us - last_us) > (i32)CLOCK_TIMEOUT_US) {
+		lock = CLOCK_IDLE;
+	}
+}
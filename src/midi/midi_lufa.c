@@ -5,11 +5,23 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+#include <string.h>
+#include <avr/pgmspace.h>
+
 #include "system/types.h"
 #include "system/error.h"
+#include "system/hardware.h"
+#include "system/latency.h"
 #include "system/print.h"
+#include "system/time.h"
+#include "system/utility.h"
 #include "event/midi.h"
 #include "midi/midi.h"
+#include "midi/clock.h"
+#include "midi/nrpn.h"
+#include "midi/throttle.h"
+#include "midi/tx_ring.h"
+#include "usb/usb.h"
 #include "usb/usb_lufa.h"
 
 #include "LUFA/Common/Common.h"
@@ -21,13 +33,48 @@
 
 #define MIDI_EVENT_QUEUE_SIZE 16
 
+// Packets in the largest group that must share one USB transaction (sysex)
+#define TX_SYSEX_PKTS_MAX (2 + ((MIDI_SYSEX_OUT_DATA_LEN_MAX + 2 + 2) / 3))
+#define TX_PKT_SIZE				(sizeof(MIDI_EventPacket_t))
+
+// Receive table entries, the message class and the number of valid bytes
+#define CIN(cls, len)		(((cls) << 2) | (len))
+#define CIN_CLASS(entry) ((entry) >> 2)
+#define CIN_LEN(entry)	 ((entry) & 0x03)
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+enum rx_class {
+	RX_IGNORE,
+	RX_SYSEX,
+	RX_NOTE_OFF,
+	RX_NOTE_ON,
+	RX_POLY_PRESSURE,
+	RX_CC,
+	RX_PROGRAM,
+	RX_CHAN_PRESSURE,
+	RX_PITCH_BEND,
+	RX_SYSTEM,
+};
+
+STATIC_ASSERT(TX_SYSEX_PKTS_MAX * TX_PKT_SIZE <= USB_MIDI_STREAM_EPSIZE,
+							"A sysex reply must fit in one endpoint bank");
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 static int									midi_out_handler(void* event);
+static int									tx_event(const midi_event_s* e);
 static enum midi_sysex_type midi_sysex_type(u8 evt);
-static int									lufa_transmit(u8* data, u8 len);
+static u8 sysex_packets(const midi_sysex_out_event_s* sysex,
+												MIDI_EventPacket_t*						pkt);
+static void cc_packet(const midi_cc_event_s* cc, MIDI_EventPacket_t* pkt);
+static void send_cc(const midi_cc_event_s* cc, u16 stamp);
+static void rx_decode(const MIDI_EventPacket_t* rx);
+static void rx_post(midi_event_s* e);
+static void tx_packets(const MIDI_EventPacket_t* pkt, u8 n, u16 stamp,
+											 bool merge);
+static bool tx_due(void);
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -38,19 +85,41 @@ USB_ClassInfo_MIDI_Device_t lufa_usb_midi_device = {
 								{
 										.Address = (USB_EP_MIDI_STREAM_IN | ENDPOINT_DIR_IN),
 										.Size		 = USB_MIDI_STREAM_EPSIZE,
-										.Banks	 = 1,
+										.Banks	 = USB_EP_BANKS,
 								},
 						.DataOUTEndpoint =
 								{
 										.Address = (USB_EP_MIDI_STREAM_OUT | ENDPOINT_DIR_OUT),
 										.Size		 = USB_MIDI_STREAM_EPSIZE,
-										.Banks	 = 1,
+										.Banks	 = USB_EP_BANKS,
 								},
 				},
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+// Indexed by the code index number (the low nibble of the packet header)
+static const u8 cin_table[16] PROGMEM = {
+		CIN(RX_IGNORE, 0),				// 0x0 Reserved
+		CIN(RX_IGNORE, 0),				// 0x1 Cable events, reserved
+		CIN(RX_SYSTEM, 2),				// 0x2 2 byte system common
+		CIN(RX_SYSTEM, 3),				// 0x3 3 byte system common
+		CIN(RX_SYSEX, 3),					// 0x4 Sysex start or continue
+		CIN(RX_SYSEX, 1),					// 0x5 1 byte system common or sysex end
+		CIN(RX_SYSEX, 2),					// 0x6 Sysex end with 2 bytes
+		CIN(RX_SYSEX, 3),					// 0x7 Sysex end with 3 bytes
+		CIN(RX_NOTE_OFF, 3),			// 0x8
+		CIN(RX_NOTE_ON, 3),				// 0x9
+		CIN(RX_POLY_PRESSURE, 3), // 0xA
+		CIN(RX_CC, 3),						// 0xB
+		CIN(RX_PROGRAM, 2),				// 0xC
+		CIN(RX_CHAN_PRESSURE, 2), // 0xD
+		CIN(RX_PITCH_BEND, 3),		// 0xE
+		CIN(RX_SYSTEM, 1),				// 0xF Single byte (realtime)
+};
+
+static struct midi_rx_stats rx_stats;
+
 static midi_event_s midi_in_event_queue[MIDI_EVENT_QUEUE_SIZE];
 static midi_event_s midi_out_event_queue[MIDI_EVENT_QUEUE_SIZE];
 
@@ -59,7 +128,6 @@ static struct event_ch_handler midi_out_event_handler = {
 		.next			= NULL,
 		.priority = 0,
 };
-
 struct event_channel midi_in_event_ch = {
 		.queue			= (u8*)midi_in_event_queue,
 		.queue_size = MIDI_EVENT_QUEUE_SIZE,
@@ -76,9 +144,6 @@ struct event_channel midi_out_event_ch = {
 		.onehandler = false,
 };
 
-// Transmit buffer for USB MIDI packets (must 4 bytes, do not change!)
-static u8 tx_buf[4];
-
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int midi_init(void) {
@@ -91,68 +156,61 @@ int midi_init(void) {
 	ret =
 			event_channel_subscribe(EVENT_CHANNEL_MIDI_OUT, &midi_out_event_handler);
 	RETURN_ON_ERR(ret);
+	midi_nrpn_reset();
 
 	return ret;
 }
 
 int midi_update(void) {
+	static u8					 session = 0;
 	MIDI_EventPacket_t rx;
+	midi_event_s			 held;
 
-	while (MIDI_Device_ReceiveEventPacket(&lufa_usb_midi_device, &rx)) {
-
-		switch (rx.Event) {
-			case MIDI_EVENT(0, MIDI_COMMAND_CONTROL_CHANGE): {
-				// println_pmem("Rx CC:");
-				midi_cc_event_s cc;
-				cc.channel = (rx.Data1 & 0x0F);
-				cc.control = rx.Data2;
-				cc.value	 = rx.Data3;
-
-				midi_event_s e;
-				e.type		= MIDI_EVENT_CC;
-				e.data.cc = cc;
-
-#ifdef ENABLE_CONSOLE
-#warning "Clib printf functions use lots of memory."
-				// char										 buf[64];
-				// static const char* const formatstr = "CH: %u, CC: %u, VAL:
-				// %u"; sprintf(buf, formatstr, cc.channel, cc.control,
-				// cc.value); println(buf);
-#endif
-
-				event_post(EVENT_CHANNEL_MIDI_IN, &e);
-				break;
-			}
+	// A new session, the host has none of the NRPN state sent before
+	if (usb_session() != session) {
+		session = usb_session();
+		midi_nrpn_reset();
+	}
 
-			case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_1BYTE):
-			case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_2BYTE):
-			case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_3BYTE):
-			case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE): //  >= 4 bytes
-			case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_2BYTE):
-			case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_3BYTE): {
-				midi_event_s e = {
-						.type = MIDI_EVENT_SYSEX,
-						.data.sysex_in =
-								{
-										.type = midi_sysex_type(rx.Event),
-										.data = {rx.Data1, rx.Data2, rx.Data3},
-								},
-				};
+	// Send the final values of throttled controls
+	while (midi_throttle_pop(&held)) {
+		tx_event(&held);
+	}
 
-				event_post(EVENT_CHANNEL_MIDI_IN, &e);
+	// Write what the endpoint can take now, the rest waits for the next pass
+	if (tx_due()) {
+		midi_tx_drain(lufa_usb_midi_device.Config.DataINEndpoint.Address,
+									USB_MIDI_STREAM_EPSIZE);
+	}
 
-				// transmit back to host
-				// MIDI_Device_SendEventPacket(&lufa_usb_midi_device, &rx);
-				break;
-			}
+	if (!usb_configured()) {
+		return 0;
+	}
 
-			default: return 0;
-		}
+	// Stop reading while MIDI in is full. Packets left in the OUT endpoint are
+	// NAKed, so the host waits for the next pass instead of losing them.
+	while (event_queue_free(EVENT_CHANNEL_MIDI_IN) > 0 &&
+				 MIDI_Device_ReceiveEventPacket(&lufa_usb_midi_device, &rx)) {
+		rx_stats.received++;
+		rx_decode(&rx);
+	}
+
+	Endpoint_SelectEndpoint(lufa_usb_midi_device.Config.DataOUTEndpoint.Address);
+	if (Endpoint_IsOUTReceived()) {
+		rx_stats.backpressure++;
 	}
 
 	return 0;
 }
 
+void midi_rx_get_stats(struct midi_rx_stats* stats) {
+	*stats = rx_stats;
+}
+
+void midi_rx_reset_stats(void) {
+	memset(&rx_stats, 0, sizeof(rx_stats));
+}
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 static int midi_out_handler(void* event) {
@@ -160,115 +218,82 @@ static int midi_out_handler(void* event) {
 
 	midi_event_s* e = (midi_event_s*)event;
 
-	MIDI_EventPacket_t pkt = {0};
+	// Held values are sent by midi_update() when their window closes
+	if (!midi_throttle(e)) {
+		return 0;
+	}
 
+	return tx_event(e);
+}
+
+static int tx_event(const midi_event_s* e) {
 	switch (e->type) {
 		case MIDI_EVENT_CC: {
-			midi_cc_event_s* cc = &e->data.cc;
 			// println_pmem("Tx CC:");
+			midi_nrpn_observe(&e->data.cc);
+			send_cc(&e->data.cc, e->stamp);
+			break;
+		}
 
-			pkt.Event = MIDI_EVENT(0, MIDI_COMMAND_CONTROL_CHANGE);
-			pkt.Data1 = ((cc->channel & 0x0F) | MIDI_COMMAND_CONTROL_CHANGE);
-			pkt.Data2 = (cc->control & 0x7F);
-			pkt.Data3 = (cc->value & 0x7F);
-
-			MIDI_Device_SendEventPacket(&lufa_usb_midi_device, &pkt);
+		case MIDI_EVENT_CC_REL: {
+			// Already paced by the vmap, and deltas must never be merged or held
+			MIDI_EventPacket_t pkt;
+			midi_nrpn_observe(&e->data.cc);
+			cc_packet(&e->data.cc, &pkt);
+			tx_packets(&pkt, 1, e->stamp, false);
 			break;
 		}
 
-		case MIDI_EVENT_SYSEX: {
-			midi_sysex_out_event_s* sysex = &e->data.sysex_out;
-
-			tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE);
-			tx_buf[1] = MIDI_STATUS_SYSTEM_EXCLUSIVE;
-			tx_buf[2] = MIDI_MFR_ID_1;
-			tx_buf[3] = MIDI_MFR_ID_2;
-			lufa_transmit(tx_buf, sizeof(tx_buf));
-
-			tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE);
-			tx_buf[1] = MIDI_MFR_ID_3;
-			tx_buf[2] = sysex->cmd;
-			tx_buf[3] = sysex->param;
-			lufa_transmit(tx_buf, sizeof(tx_buf));
-
-			u8	 remaining = sysex->data_len;
-			u8*	 payload	 = sysex->data;
-			bool done			 = false;
-
-			switch (sysex->data_len) {
-				case 0: {
-					tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_1BYTE);
-					tx_buf[1] = MIDI_STATUS_END_OF_EXCLUSIVE;
-					tx_buf[2] = 0;
-					tx_buf[3] = 0;
-					done			= true;
-					break;
-				}
-
-				case 1: {
-					tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_3BYTE);
-					tx_buf[1] = sysex->data_len;
-					tx_buf[2] = *payload;
-					tx_buf[3] = MIDI_STATUS_END_OF_EXCLUSIVE;
-					done			= true;
-					break;
-				}
-
-				default:
-				case 2: {
-					tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE);
-					tx_buf[1] = sysex->data_len;
-					tx_buf[2] = *payload++;
-					tx_buf[3] = *payload++;
-					break;
-				}
+		case MIDI_EVENT_CC_14: {
+			// Throttled as one control, the MSB and LSB must stay together
+			const midi_cc14_event_s* cc14 = &e->data.cc14;
+			midi_cc_event_s					 cc[2];
+			MIDI_EventPacket_t			 pkt[2];
+
+			cc[0].channel = cc14->channel;
+			cc[0].control = cc14->control;
+			cc[0].value		= (cc14->value >> 7) & 0x7F;
+			cc[1].channel = cc14->channel;
+			cc[1].control = cc14->control + 32;
+			cc[1].value		= cc14->value & 0x7F;
+
+			for (u8 i = 0; i < 2; i++) {
+				midi_nrpn_observe(&cc[i]);
+				cc_packet(&cc[i], &pkt[i]);
 			}
+			tx_packets(pkt, 2, e->stamp, true);
+			break;
+		}
 
-			lufa_transmit(tx_buf, sizeof(tx_buf));
-
-			while (!done) {
-				memset(tx_buf, 0, sizeof(tx_buf));
-				switch (remaining) {
-					case 0: {
-						tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_1BYTE);
-						tx_buf[1] = MIDI_STATUS_END_OF_EXCLUSIVE;
-						done			= true;
-						remaining = 0;
-						break;
-					}
-
-					case 1: {
-						tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_2BYTE);
-						tx_buf[1] = sysex->data[*payload++];
-						tx_buf[2] = MIDI_STATUS_END_OF_EXCLUSIVE;
-						done			= true;
-						remaining = 0;
-						break;
-					}
-
-					case 2: {
-						tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_3BYTE);
-						tx_buf[1] = sysex->data[*payload++];
-						tx_buf[2] = sysex->data[*payload++];
-						tx_buf[3] = MIDI_STATUS_END_OF_EXCLUSIVE;
-						done			= true;
-						remaining = 0;
-						break;
-					}
-
-					default:
-					case 3: {
-						tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE);
-						tx_buf[1] = sysex->data[*payload++];
-						tx_buf[2] = sysex->data[*payload++];
-						tx_buf[3] = sysex->data[*payload++];
-						remaining -= 3;
-						break;
-					}
-						lufa_transmit(tx_buf, sizeof(tx_buf));
-				}
+		case MIDI_EVENT_NRPN: {
+			// Throttled as one control, the CCs of one message must stay together
+			midi_cc_event_s		 cc[MIDI_NRPN_MAX_CC];
+			MIDI_EventPacket_t pkt[MIDI_NRPN_MAX_CC];
+			u8								 n = midi_nrpn_encode(&e->data.nrpn, cc);
+
+			for (u8 i = 0; i < n; i++) {
+				cc_packet(&cc[i], &pkt[i]);
 			}
+			tx_packets(pkt, n, e->stamp, true);
+			break;
+		}
 
+		case MIDI_EVENT_PITCH_BEND: {
+			MIDI_EventPacket_t pkt = {
+					.Event = MIDI_EVENT(0, MIDI_COMMAND_PITCH_WHEEL_CHANGE),
+					.Data1 = ((e->data.bend.channel & 0x0F) |
+										MIDI_COMMAND_PITCH_WHEEL_CHANGE),
+					.Data2 = (e->data.bend.value & 0x7F),
+					.Data3 = ((e->data.bend.value >> 7) & 0x7F),
+			};
+			tx_packets(&pkt, 1, e->stamp, true);
+			break;
+		}
+
+		case MIDI_EVENT_SYSEX: {
+			MIDI_EventPacket_t pkt[TX_SYSEX_PKTS_MAX];
+			tx_packets(pkt, sysex_packets(&e->data.sysex_out, pkt), e->stamp,
+								 true);
 			break;
 		}
 
@@ -299,20 +324,197 @@ static enum midi_sysex_type midi_sysex_type(u8 evt) {
 	}
 }
 
-static int lufa_transmit(u8* data, u8 len) {
-	if (USB_DeviceState != DEVICE_STATE_Configured)
-		return ENDPOINT_RWSTREAM_DeviceDisconnected;
+// Build the packets of a sysex reply: header, data length, data, end
+static u8 sysex_packets(const midi_sysex_out_event_s* sysex,
+												MIDI_EventPacket_t*						pkt) {
+	u8 n = 0;
+
+	pkt[n++] = (MIDI_EventPacket_t){
+			.Event = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE),
+			.Data1 = MIDI_STATUS_SYSTEM_EXCLUSIVE,
+			.Data2 = MIDI_MFR_ID_1,
+			.Data3 = MIDI_MFR_ID_2,
+	};
+
+	pkt[n++] = (MIDI_EventPacket_t){
+			.Event = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE),
+			.Data1 = MIDI_MFR_ID_3,
+			.Data2 = sysex->cmd,
+			.Data3 = sysex->param,
+	};
+
+	// The payload is the data length, the data, then the end of exclusive
+	u8 payload[MIDI_SYSEX_OUT_DATA_LEN_MAX + 2];
+	u8 len			= 0;
+	u8 data_len = MIN(sysex->data_len, MIDI_SYSEX_OUT_DATA_LEN_MAX);
+
+	payload[len++] = data_len;
+	for (u8 i = 0; i < data_len; i++) {
+		payload[len++] = sysex->data[i] & 0x7F;
+	}
+	payload[len++] = MIDI_STATUS_END_OF_EXCLUSIVE;
+
+	// Send in 3 byte packets, the final packet uses the matching end CIN
+	for (u8 i = 0; i < len; i += 3) {
+		u8									rem = MIN(len - i, 3);
+		MIDI_EventPacket_t* p		= &pkt[n++];
+
+		memset(p, 0, sizeof(MIDI_EventPacket_t));
+		memcpy(&p->Data1, &payload[i], rem);
+
+		if ((i + rem) < len) {
+			p->Event = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE);
+		} else if (rem == 1) {
+			p->Event = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_1BYTE);
+		} else if (rem == 2) {
+			p->Event = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_2BYTE);
+		} else {
+			p->Event = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_3BYTE);
+		}
+	}
+
+	return n;
+}
+
+static void cc_packet(const midi_cc_event_s* cc, MIDI_EventPacket_t* pkt) {
+	pkt->Event = MIDI_EVENT(0, MIDI_COMMAND_CONTROL_CHANGE);
+	pkt->Data1 = ((cc->channel & 0x0F) | MIDI_COMMAND_CONTROL_CHANGE);
+	pkt->Data2 = (cc->control & 0x7F);
+	pkt->Data3 = (cc->value & 0x7F);
+}
+
+static void send_cc(const midi_cc_event_s* cc, u16 stamp) {
+	MIDI_EventPacket_t pkt;
+	cc_packet(cc, &pkt);
+	tx_packets(&pkt, 1, stamp, true);
+}
+
+// Queue a group of packets, see midi_tx_drain() for when they are sent
+static void tx_packets(const MIDI_EventPacket_t* pkt, u8 n, u16 stamp,
+											 bool merge) {
+	if (!usb_configured()) {
+		return;
+	}
+
+	midi_tx_push(pkt, n, stamp, merge);
+}
+
+// Convert a received packet to a MIDI in event
+static void rx_decode(const MIDI_EventPacket_t* rx) {
+	u8 entry = pgm_read_byte(&cin_table[rx->Event & 0x0F]);
+	u8 cls	 = CIN_CLASS(entry);
+	u8 len	 = CIN_LEN(entry);
+	u8 ch		 = rx->Data1 & 0x0F;
+
+	// CIN 0x5 is shared by single byte system common messages (tune request)
+	if (cls == RX_SYSEX && rx->Data1 > MIDI_STATUS_SYSTEM_EXCLUSIVE &&
+			rx->Data1 != MIDI_STATUS_END_OF_EXCLUSIVE) {
+		cls = RX_SYSTEM;
+	}
 
-	uint8_t ErrorCode;
+	u32					 now = systime_us();
+	midi_event_s e;
 
-	Endpoint_SelectEndpoint(lufa_usb_midi_device.Config.DataINEndpoint.Address);
+	e.stamp = latency_tag(now);
 
-	if ((ErrorCode = Endpoint_Write_Stream_LE(data, len, NULL)) !=
-			ENDPOINT_RWSTREAM_NoError)
-		return ErrorCode;
+	switch (cls) {
+		case RX_SYSEX:
+			e.type									= MIDI_EVENT_SYSEX;
+			e.data.sysex_in.type		= midi_sysex_type(rx->Event);
+			e.data.sysex_in.data[0] = rx->Data1;
+			e.data.sysex_in.data[1] = rx->Data2;
+			e.data.sysex_in.data[2] = rx->Data3;
+			break;
 
-	if (!(Endpoint_IsReadWriteAllowed()))
-		Endpoint_ClearIN();
+		case RX_NOTE_ON:
+			// Velocity 0 is a note off
+			if (rx->Data3 != 0) {
+				e.type = MIDI_EVENT_NOTE_ON;
+			} else {
+				e.type = MIDI_EVENT_NOTE_OFF;
+			}
+			e.data.note.channel = ch;
+			e.data.note.note		= rx->Data2;
+			e.data.note.value		= rx->Data3;
+			break;
+
+		case RX_NOTE_OFF:
+		case RX_POLY_PRESSURE:
+			if (cls == RX_NOTE_OFF) {
+				e.type = MIDI_EVENT_NOTE_OFF;
+			} else {
+				e.type = MIDI_EVENT_POLY_PRESSURE;
+			}
+			e.data.note.channel = ch;
+			e.data.note.note		= rx->Data2;
+			e.data.note.value		= rx->Data3;
+			break;
+
+		case RX_CC:
+			e.type						= MIDI_EVENT_CC;
+			e.data.cc.channel = ch;
+			e.data.cc.control = rx->Data2;
+			e.data.cc.value		= rx->Data3;
+			break;
 
-	return MIDI_Device_Flush(&lufa_usb_midi_device);
+		case RX_PROGRAM:
+		case RX_CHAN_PRESSURE:
+			if (cls == RX_PROGRAM) {
+				e.type = MIDI_EVENT_PROGRAM;
+			} else {
+				e.type = MIDI_EVENT_CHAN_PRESSURE;
+			}
+			e.data.chan.channel = ch;
+			e.data.chan.value		= rx->Data2;
+			break;
+
+		case RX_PITCH_BEND:
+			e.type							= MIDI_EVENT_PITCH_BEND;
+			e.data.bend.channel = ch;
+			e.data.bend.value		= (rx->Data2 & 0x7F) | ((rx->Data3 & 0x7F) << 7);
+			break;
+
+		case RX_SYSTEM:
+			e.type								= MIDI_EVENT_SYSTEM;
+			e.data.system.status	= rx->Data1;
+			e.data.system.data[0] = (len > 1) ? rx->Data2 : 0;
+			e.data.system.data[1] = (len > 2) ? rx->Data3 : 0;
+
+			// Clock and transport skip the queue so the tick timestamps stay tight
+			if (midi_clock_rx(&e.data.system, now)) {
+				return;
+			}
+			break;
+
+		default: return; // Reserved or cable events, ignored
+	}
+
+	rx_post(&e);
+}
+
+/*
+	Frame aligned output stages packets in the ring for the rest of a USB frame
+	and commits them in one pass after the next SOF, so each frame carries the
+	packets queued during the previous one.
+*/
+static bool tx_due(void) {
+	static u8 last_sof = 0;
+
+	if (!gCONFIG.midi_tx_sof) {
+		return true;
+	}
+
+	u8 sof = usb_sof_count();
+	if (sof == last_sof) {
+		return false;
+	}
+
+	last_sof = sof;
+	return true;
+}
+
+static void rx_post(midi_event_s* e) {
+	if (event_post(EVENT_CHANNEL_MIDI_IN, e) != 0) {
+		rx_stats.dropped++;
+	}
 }
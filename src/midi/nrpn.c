@@ -0,0 +1,96 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <string.h>
+
+#include "midi/nrpn.h"
+#include "midi/midi_cc.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define NUM_CHANNELS (16)
+
+// Parameter numbers are 14-bit, bit 15 marks a registered parameter
+#define PARAM_RPN		 (0x8000)
+#define PARAM_NONE	 (0xFFFF)
+#define MSB_NONE		 (0xFF)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// What the receiver last saw on a channel
+struct nrpn_state {
+	u16 param; // Selected parameter, or PARAM_NONE if unknown
+	u8	msb;	 // Data Entry MSB, or MSB_NONE if unknown
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static struct nrpn_state state[NUM_CHANNELS];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void midi_nrpn_reset(void) {
+	memset(state, 0xFF, sizeof(state));
+}
+
+u8 midi_nrpn_encode(const midi_nrpn_event_s* nrpn, midi_cc_event_s* cc) {
+	struct nrpn_state* s		 = &state[nrpn->channel & 0x0F];
+	u16								 param = (nrpn->param & 0x3FFF) | (nrpn->rpn ? PARAM_RPN : 0);
+	u8								 msb	 = (nrpn->value >> 7) & 0x7F;
+	u8								 n		 = 0;
+
+	if (s->param != param) {
+		cc[n].control = nrpn->rpn ? MIDI_CC_REGIST_PARM_NUM_MSB
+															: MIDI_CC_NONREG_PARM_NUM_MSB;
+		cc[n++].value = (nrpn->param >> 7) & 0x7F;
+		cc[n].control = nrpn->rpn ? MIDI_CC_REGIST_PARM_NUM_LSB
+															: MIDI_CC_NONREG_PARM_NUM_LSB;
+		cc[n++].value = nrpn->param & 0x7F;
+	}
+
+	// The MSB may reset the LSB at the receiver, so the LSB is always sent
+	if (s->param != param || s->msb != msb) {
+		cc[n].control = MIDI_CC_MSB_DATA_ENTRY;
+		cc[n++].value = msb;
+	}
+
+	cc[n].control = MIDI_CC_LSB_DATA_ENTRY;
+	cc[n++].value = nrpn->value & 0x7F;
+
+	for (u8 i = 0; i < n; i++) {
+		cc[i].channel = nrpn->channel;
+	}
+
+	s->param = param;
+	s->msb	 = msb;
+	return n;
+}
+
+void midi_nrpn_observe(const midi_cc_event_s* cc) {
+	struct nrpn_state* s = &state[cc->channel & 0x0F];
+
+	switch (cc->control) {
+		case MIDI_CC_NONREG_PARM_NUM_MSB:
+		case MIDI_CC_NONREG_PARM_NUM_LSB:
+		case MIDI_CC_REGIST_PARM_NUM_MSB:
+		case MIDI_CC_REGIST_PARM_NUM_LSB:
+		case MIDI_CC_MSB_DATA_ENTRY:
+		case MIDI_CC_LSB_DATA_ENTRY:
+		case MIDI_CC_DATA_INCREMENT:
+		case MIDI_CC_DATA_DECREMENT:
+		case MIDI_CC_RESET_CONTROLLERS:
+			s->param = PARAM_NONE;
+			s->msb	 = MSB_NONE;
+			break;
+
+		default: break;
+	}
+}
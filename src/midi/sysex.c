@@ -10,6 +10,10 @@
 
 #include "midi/sysex.h"
 #include "event/midi.h"
+#include "system/latency.h"
+#include "system/time.h"
+#include "virtmap/index.h"
+#include "virtmap/snapshot.h"
 
 // Test sequence:
 // [sysex start] [mfid] [cmd] [param] [data] [sysex end]
@@ -47,6 +51,12 @@ struct sysex_item_data_info {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 static int midi_in_handler(void* evt);
+static u8	 encoder_stats(u8 enc_idx, u8* data);
+static int	 latency_page(u8 path, u8 page, u8* data);
+static u8	 ping_reply(const mf_sysex_ping_param_s* ping, u16 stamp,
+											u8* data);
+static void put_u14(u8* data, u16 val);
+static void put_u21(u8* data, u32 val);
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -87,6 +97,9 @@ static const struct sysex_item_data_info sysex_data_info[MF_SYSEX_PARAM_NB] = {
 	SYSEX_DATA_INFO(MF_SYSEX_PARAM_VMAP_PROTO, struct virtmap, cfg),
 	SYSEX_DATA_INFO(MF_SYSEX_PARAM_SIDE_SWITCH, struct mf_rt, curr_bank),
 	SYSEX_DATA_INFO(MF_SYSEX_PARAM_ACTIVE_BANK, struct mf_rt, curr_bank),
+	SYSEX_DATA_INFO(MF_SYSEX_PARAM_ENCODER_ACCEL_PROFILE, struct encoder, enc_ctx.accel_profile),
+	SYSEX_DATA_INFO(MF_SYSEX_PARAM_VMAP_HIRES, struct virtmap, hires),
+	SYSEX_DATA_INFO(MF_SYSEX_PARAM_VMAP_CURVE, struct virtmap, curve),
 };
 
 // clang-format on
@@ -108,6 +121,10 @@ static int midi_in_handler(void* evt) {
 	int						ret	 = 0;
 	midi_event_s* midi = (midi_event_s*)evt;
 
+	// Parameters that return data fill this, otherwise the reply is the result
+	u8 reply_data[MIDI_SYSEX_OUT_DATA_LEN_MAX];
+	u8 reply_len = 0;
+
 	if (midi->type != MIDI_EVENT_SYSEX) {
 		return 0; // Ignore non-sysex events
 	} else if (midi->data.sysex_in.type == SYSEX_TYPE_INVALID) {
@@ -186,11 +203,31 @@ static int midi_in_handler(void* evt) {
 		case MF_SYSEX_PARAM_ENCODER_VMAP_ACTIVE:
 		case MF_SYSEX_PARAM_ENCODER_SWITCH_STATE:
 		case MF_SYSEX_PARAM_ENCODER_SWITCH_MODE:
-		case MF_SYSEX_PARAM_ENCODER_SWITCH_PROTO: {
+		case MF_SYSEX_PARAM_ENCODER_SWITCH_PROTO:
+		case MF_SYSEX_PARAM_ENCODER_ACCEL_PROFILE: {
 			u8							bank		= msg->param.enc.bank_idx;
 			u8							enc			= msg->param.enc.enc_idx;
+			if (bank >= NUM_ENC_BANKS || enc >= NUM_ENCODERS) {
+				ret = ERR_BAD_PARAM;
+				break;
+			}
+
 			struct encoder* encoder = &gENCODERS[bank][enc];
-			void*						param =
+
+			// The active vmap must be within the encoder's slice of the pool
+			if (msg->param_enum == MF_SYSEX_PARAM_ENCODER_VMAP_ACTIVE &&
+					msg->param.enc.data.vmap_active >= encoder->vmap_count) {
+				ret = ERR_BAD_PARAM;
+				break;
+			}
+
+			if (msg->param_enum == MF_SYSEX_PARAM_ENCODER_ACCEL_PROFILE &&
+					msg->param.enc.data.accel_profile >= ENC_ACCEL_PROFILE_NB) {
+				ret = ERR_BAD_PARAM;
+				break;
+			}
+
+			void* param =
 					(void*)((u8*)encoder + sysex_data_info[msg->param_enum].offset);
 			memcpy(param, (const void*)&msg->param.enc.data,
 						 sysex_data_info[msg->param_enum].len);
@@ -201,15 +238,26 @@ static int midi_in_handler(void* evt) {
 		case MF_SYSEX_PARAM_VMAP_POSITION:
 		case MF_SYSEX_PARAM_VMAP_RGB:
 		case MF_SYSEX_PARAM_VMAP_RB:
-		case MF_SYSEX_PARAM_VMAP_PROTO: {
-			u8							bank_idx = msg->param.vmap.bank_idx;
-			u8							enc_idx	 = msg->param.vmap.enc_idx;
-			u8							vmap_idx = msg->param.vmap.vmap_idx;
-			struct virtmap* vmap		 = &gENCODERS[bank_idx][enc_idx].vmaps[vmap_idx];
+		case MF_SYSEX_PARAM_VMAP_PROTO:
+		case MF_SYSEX_PARAM_VMAP_HIRES:
+		case MF_SYSEX_PARAM_VMAP_CURVE: {
+			u8 id = vmap_id(msg->param.vmap.bank_idx, msg->param.vmap.enc_idx,
+											msg->param.vmap.vmap_idx);
+			if (id == VMAP_ID_NONE) {
+				ret = ERR_BAD_PARAM;
+				break;
+			}
+
+			struct virtmap* vmap = &gVMAP_POOL[id];
 			void*						param =
 					(void*)((u8*)vmap + sysex_data_info[msg->param_enum].offset);
 			memcpy(param, (const void*)&msg->param.vmap.data,
 						 sysex_data_info[msg->param_enum].len);
+
+			vmap_compile(vmap);
+			if (msg->param_enum == MF_SYSEX_PARAM_VMAP_PROTO) {
+				vmap_index_update(id);
+			}
 			break;
 		}
 
@@ -217,10 +265,94 @@ static int midi_in_handler(void* evt) {
 			break;
 		}
 
+		case MF_SYSEX_PARAM_ENCODER_STATS: {
+			// Statistics belong to the physical encoder, the bank is ignored.
+			// GET returns the statistics, SET clears them.
+			u8 enc_idx = msg->param.enc.enc_idx;
+			if (enc_idx >= NUM_ENCODERS) {
+				ret = ERR_BAD_PARAM;
+			} else if (msg->cmd == MF_SYSEX_GET) {
+				reply_len = encoder_stats(enc_idx, reply_data);
+			} else {
+				quadrature_stats_reset(&gQUAD_ENC[enc_idx]);
+			}
+			break;
+		}
+
 		case MF_SYSEX_PARAM_ACTIVE_BANK: {
 			break;
 		}
 
+		case MF_SYSEX_PARAM_ENCODER_VMAP_COUNT: {
+			// GET returns the count and the free vmaps in the pool, SET resizes
+			u8 bank_idx = msg->param.enc.bank_idx;
+			u8 enc_idx	= msg->param.enc.enc_idx;
+			if (bank_idx >= NUM_ENC_BANKS || enc_idx >= NUM_ENCODERS) {
+				ret = ERR_BAD_PARAM;
+				break;
+			}
+
+			struct encoder* enc = &gENCODERS[bank_idx][enc_idx];
+			if (msg->cmd == MF_SYSEX_GET) {
+				reply_data[0] = enc->vmap_count;
+				reply_data[1] = vmap_pool_free();
+				reply_len			= 2;
+			} else {
+				ret = vmap_pool_resize(enc, msg->param.enc.data.vmap_count);
+			}
+			break;
+		}
+
+		case MF_SYSEX_PARAM_SNAPSHOT: {
+			// Send the values of a bank (or VMAP_SNAPSHOT_ALL_BANKS) after the reply
+			ret = vmap_snapshot_start(msg->param.enc.bank_idx);
+			break;
+		}
+
+		case MF_SYSEX_PARAM_LATENCY: {
+			// GET returns a page of the measurements of a path (bank_idx selects
+			// the path, enc_idx the page), SET clears every path.
+			if (msg->cmd == MF_SYSEX_GET) {
+				ret = latency_page(msg->param.enc.bank_idx, msg->param.enc.enc_idx,
+													 reply_data);
+				reply_len = (ret == 0) ? 8 : 0;
+			} else {
+				latency_reset();
+			}
+			break;
+		}
+
+		case MF_SYSEX_PARAM_PING: {
+			// Answered straight away, the host times the round trip
+			if (msg->cmd == MF_SYSEX_GET) {
+				reply_len = ping_reply(&msg->param.ping, midi->stamp, reply_data);
+			} else {
+				ret = ERR_UNSUPPORTED;
+			}
+			break;
+		}
+
+		case MF_SYSEX_PARAM_CURVE_POINT: {
+			// GET returns the point, SET writes it. Points are sent as 14-bit.
+			const mf_sysex_curve_param_s* curve = &msg->param.curve;
+			if (curve->user_idx >= VMAP_CURVE_USER_NB ||
+					curve->point_idx >= VMAP_CURVE_POINTS) {
+				ret = ERR_BAD_PARAM;
+			} else if (msg->cmd == MF_SYSEX_GET) {
+				put_u14(reply_data,
+								gVMAP_USER_CURVES[curve->user_idx][curve->point_idx] >> 2);
+				reply_len = 2;
+			} else {
+				u16 val = ((u16)(curve->value[0] & 0x7F) << 7) |
+									(curve->value[1] & 0x7F);
+
+				// Expand to 16-bit so that 0x3FFF maps to 0xFFFF
+				ret = vmap_curve_set_point(curve->user_idx, curve->point_idx,
+																	 (u16)((val << 2) | (val >> 12)));
+			}
+			break;
+		}
+
 		default: {
 			ret = ERR_BAD_PARAM;
 		}
@@ -242,6 +374,12 @@ static int midi_in_handler(void* evt) {
 									.data			= ret,
 							},
 			};
+
+			if (reply_len > 0) {
+				reply.data.sysex_out.data_len = reply_len;
+				memcpy(reply.data.sysex_out.data, reply_data, reply_len);
+			}
+
 			event_post(EVENT_CHANNEL_MIDI_OUT, &reply);
 			break;
 		}
@@ -273,3 +411,89 @@ cleanup:
 	stream_state = STREAM_IDLE;
 	return ret;
 }
+
+// Encode the statistics of an encoder as 14-bit values, returns the length
+static u8 encoder_stats(u8 enc_idx, u8* data) {
+	const struct quadrature* quad = &gQUAD_ENC[enc_idx];
+
+	put_u14(&data[0], quad->stats.invalid);
+	put_u14(&data[2], quad->stats.reversals);
+	put_u14(&data[4], quadrature_max_step_rate(quad));
+
+	return 6;
+}
+
+/*
+	Encode a page of latency measurements as four 14-bit values, in units of
+	LATENCY_TAG_US. Page 0 is the count, min, mean and max, page 1 the 50th,
+	90th, 95th and 99th percentiles, and the following pages the histogram bins
+	in order.
+*/
+static int latency_page(u8 path, u8 page, u8* data) {
+	struct latency_stats stats;
+	u16									 val[4] = {0};
+
+	if (path >= LATENCY_PATH_NB) {
+		return ERR_BAD_PARAM;
+	}
+
+	latency_get(path, &stats);
+
+	if (page == 0) {
+		val[0] = stats.count;
+		val[1] = stats.min;
+		val[2] = stats.count ? (u16)(stats.sum / stats.count) : 0;
+		val[3] = stats.max;
+	} else if (page == 1) {
+		val[0] = latency_percentile(&stats, 50);
+		val[1] = latency_percentile(&stats, 90);
+		val[2] = latency_percentile(&stats, 95);
+		val[3] = latency_percentile(&stats, 99);
+	} else if ((page - 2) * 4 < LATENCY_BINS) {
+		for (u8 i = 0; i < 4; i++) {
+			u8 bin = ((page - 2) * 4) + i;
+			val[i] = (bin < LATENCY_BINS) ? stats.bins[bin] : 0;
+		}
+	} else {
+		return ERR_BAD_PARAM;
+	}
+
+	for (u8 i = 0; i < 4; i++) {
+		put_u14(&data[i * 2], val[i]);
+	}
+
+	return 0;
+}
+
+/*
+	Echo the nonce of a ping with the time its last packet was read from the
+	endpoint and the time the reply is queued, 21-bit each in units of
+	LATENCY_TAG_US. The host subtracts the time spent in the device from the
+	round trip, see scripts/sysex_ping.py.
+*/
+static u8 ping_reply(const mf_sysex_ping_param_s* ping, u16 stamp, u8* data) {
+	u32 now_us = systime_us();
+	u32 tx		 = now_us / LATENCY_TAG_US;
+	u32 rx		 = tx - (u16)(latency_tag(now_us) - stamp);
+
+	data[0] = ping->nonce[0] & 0x7F;
+	data[1] = ping->nonce[1] & 0x7F;
+	put_u21(&data[2], rx);
+	put_u21(&data[5], tx);
+
+	return 8;
+}
+
+// SysEx data bytes are 7-bit, values saturate at 0x3FFF (MSB first)
+static void put_u14(u8* data, u16 val) {
+	val			= MIN(val, 0x3FFF);
+	data[0] = (val >> 7) & 0x7F;
+	data[1] = val & 0x7F;
+}
+
+// The low 21 bits of a value that wraps, such as a timestamp (MSB first)
+static void put_u21(u8* data, u32 val) {
+	data[0] = (val >> 14) & 0x7F;
+	data[1] = (val >> 7) & 0x7F;
+	data[2] = val & 0x7F;
+}
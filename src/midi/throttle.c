@@ -0,0 +1,196 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "midi/throttle.h"
+#include "system/hardware.h"
+#include "system/latency.h"
+#include "system/time.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define SLOT_NONE (0xFF)
+
+// Parameter numbers are 14-bit, bit 15 marks a registered parameter
+#define KEY_RPN (0x8000)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct throttle_slot {
+	u8	type; // enum midi_event
+	u8	channel;
+	u16 key;		 // Control, MSB control or parameter number
+	u16 value;	 // Held value, valid if pending
+	u8	pending;
+	u16 last_tx; // Time (ms) of the last value sent
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool event_key(const midi_event_s* e, u16* key, u16* value);
+static u8		slot_find(u8 type, u8 channel, u16 key, u16 now);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static struct throttle_slot slots[MIDI_THROTTLE_SLOTS];
+static u8										num_pending;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool midi_throttle(const midi_event_s* e) {
+	u16 key;
+	u16 value;
+
+	if (gCONFIG.midi_throttle_time == 0 || !event_key(e, &key, &value)) {
+		return true;
+	}
+
+	// The channel is the first member of every throttled event
+	u16 now = (u16)systime_ms();
+	u8	i		= slot_find(e->type, e->data.cc.channel, key, now);
+
+	if (i == SLOT_NONE) {
+		return true; // Every slot is holding a value, do not drop this one
+	}
+
+	struct throttle_slot* slot = &slots[i];
+
+	if ((u16)(now - slot->last_tx) >= gCONFIG.midi_throttle_time) {
+		if (slot->pending) {
+			slot->pending = false;
+			num_pending--;
+		}
+		slot->last_tx = now;
+		return true;
+	}
+
+	if (!slot->pending) {
+		slot->pending = true;
+		num_pending++;
+	}
+	slot->value = value;
+	return false;
+}
+
+bool midi_throttle_pop(midi_event_s* e) {
+	if (num_pending == 0) {
+		return false;
+	}
+
+	u16 now = (u16)systime_ms();
+
+	for (u8 i = 0; i < MIDI_THROTTLE_SLOTS; i++) {
+		struct throttle_slot* slot = &slots[i];
+
+		if (!slot->pending ||
+				(u16)(now - slot->last_tx) < gCONFIG.midi_throttle_time) {
+			continue;
+		}
+
+		e->type	 = slot->type;
+		e->stamp = LATENCY_TAG_NONE; // Delayed on purpose
+
+		switch (slot->type) {
+			case MIDI_EVENT_CC:
+				e->data.cc.channel = slot->channel;
+				e->data.cc.control = (u8)slot->key;
+				e->data.cc.value	 = (u8)slot->value;
+				break;
+
+			case MIDI_EVENT_CC_14:
+				e->data.cc14.channel = slot->channel;
+				e->data.cc14.control = (u8)slot->key;
+				e->data.cc14.value	 = slot->value;
+				break;
+
+			case MIDI_EVENT_NRPN:
+				e->data.nrpn.channel = slot->channel;
+				e->data.nrpn.rpn		 = (slot->key & KEY_RPN) != 0;
+				e->data.nrpn.param	 = slot->key & 0x3FFF;
+				e->data.nrpn.value	 = slot->value;
+				break;
+
+			case MIDI_EVENT_PITCH_BEND:
+			default:
+				e->data.bend.channel = slot->channel;
+				e->data.bend.value	 = slot->value;
+				break;
+		}
+
+		slot->pending = false;
+		slot->last_tx = now;
+		num_pending--;
+		return true;
+	}
+
+	return false;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Identify the control an event sets, false if the event is not throttled
+static bool event_key(const midi_event_s* e, u16* key, u16* value) {
+	switch (e->type) {
+		case MIDI_EVENT_CC:
+			*key	 = e->data.cc.control;
+			*value = e->data.cc.value;
+			return true;
+
+		case MIDI_EVENT_CC_14:
+			*key	 = e->data.cc14.control;
+			*value = e->data.cc14.value;
+			return true;
+
+		case MIDI_EVENT_NRPN:
+			*key	 = (e->data.nrpn.param & 0x3FFF) | (e->data.nrpn.rpn ? KEY_RPN : 0);
+			*value = e->data.nrpn.value;
+			return true;
+
+		case MIDI_EVENT_PITCH_BEND:
+			*key	 = 0;
+			*value = e->data.bend.value;
+			return true;
+
+		default: return false;
+	}
+}
+
+/*
+	Find the slot of a control, or claim one for it. Idle slots whose window has
+	closed are free, then any slot that is not holding a value. A reclaimed
+	slot starts with its window closed.
+*/
+static u8 slot_find(u8 type, u8 channel, u16 key, u16 now) {
+	u8 idle	 = SLOT_NONE;
+	u8 spare = SLOT_NONE;
+
+	for (u8 i = 0; i < MIDI_THROTTLE_SLOTS; i++) {
+		struct throttle_slot* slot = &slots[i];
+
+		if (slot->type == type && slot->channel == channel && slot->key == key) {
+			return i;
+		} else if (slot->pending) {
+			continue;
+		} else if ((u16)(now - slot->last_tx) >= gCONFIG.midi_throttle_time) {
+			idle = i;
+		} else {
+			spare = i;
+		}
+	}
+
+	u8 i = (idle != SLOT_NONE) ? idle : spare;
+	if (i != SLOT_NONE) {
+		slots[i].type		 = type;
+		slots[i].channel = channel;
+		slots[i].key		 = key;
+		slots[i].last_tx = now - gCONFIG.midi_throttle_time;
+	}
+
+	return i;
+}
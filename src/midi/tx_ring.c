@@ -0,0 +1,377 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <string.h>
+
+#include "midi/tx_ring.h"
+#include "midi/midi_cc.h"
+#include "midi/nrpn.h"
+#include "system/hardware.h"
+#include "system/latency.h"
+#include "system/utility.h"
+#include "usb/usb.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define RING_MASK (MIDI_TX_RING_SIZE - 1)
+#define PKT_SIZE	(sizeof(MIDI_EventPacket_t))
+
+// Code index number of a control change packet
+#define CIN_CC		(0x0B)
+
+// NRPN state of a channel that a group sets (PARAM, MSB) or depends on (DATA)
+#define NRPN_PARAM (1 << 0)
+#define NRPN_MSB	 (1 << 1)
+#define NRPN_DATA	 (1 << 2)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+STATIC_ASSERT((MIDI_TX_RING_SIZE & RING_MASK) == 0,
+							"MIDI_TX_RING_SIZE must be a power of 2");
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static u8		group_len(u8 idx);
+static void drop_oldest(void);
+static void drop_observe(const MIDI_EventPacket_t* pkt);
+static void drop_dependents(u8 channel, u8 lost);
+static u8		group_nrpn(u8 idx, u8 len, u8* channel);
+static bool coalesce(const MIDI_EventPacket_t* pkt, u8 n);
+static bool ring_bit(const u8* bits, u8 idx);
+static void ring_bit_set(u8* bits, u8 idx, bool set);
+static bool can_coalesce(const MIDI_EventPacket_t* pkt);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static MIDI_EventPacket_t ring[MIDI_TX_RING_SIZE];
+static u8									ring_more[MIDI_TX_RING_SIZE / 8]; // Set if the group continues
+static u8									ring_fixed[MIDI_TX_RING_SIZE / 8]; // Set if the group cannot merge
+static u16								ring_stamp[MIDI_TX_RING_SIZE]; // At the first packet of a group
+static u8									head;	 // Next free entry
+static u8									count; // Packets queued
+
+static struct midi_tx_stats stats;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool midi_tx_push(const MIDI_EventPacket_t* pkt, u8 n, u16 stamp,
+									bool merge) {
+	if (n == 0 || n > MIDI_TX_RING_SIZE) {
+		return false;
+	}
+
+	if ((MIDI_TX_RING_SIZE - count) < n) {
+		switch (gCONFIG.midi_tx_policy) {
+			case MIDI_TX_COALESCE:
+				if (merge && coalesce(pkt, n)) {
+					stats.coalesced += n;
+					return true;
+				}
+				break;
+
+			case MIDI_TX_DROP_NEWEST:
+				for (u8 i = 0; i < n; i++) {
+					drop_observe(&pkt[i]);
+				}
+				stats.dropped_newest += n;
+				return false;
+
+			case MIDI_TX_DROP_OLDEST:
+			default: break;
+		}
+
+		while ((MIDI_TX_RING_SIZE - count) < n) {
+			drop_oldest();
+		}
+	}
+
+	for (u8 i = 0; i < n; i++) {
+		u8 idx		= (head + i) & RING_MASK;
+		ring[idx] = pkt[i];
+
+		ring_bit_set(ring_more, idx, i < (n - 1));
+	}
+
+	ring_bit_set(ring_fixed, head, !merge);
+	ring_stamp[head] = stamp;
+
+	head	= (head + n) & RING_MASK;
+	count = count + n;
+
+	stats.high_water = MAX(stats.high_water, count);
+	return true;
+}
+
+void midi_tx_drain(u8 ep, u8 ep_size) {
+	if (!usb_configured()) {
+		count = 0; // Stale once the host is gone
+		return;
+	}
+
+	Endpoint_SelectEndpoint(ep);
+
+	while (count > 0) {
+		// The bank is busy until the host reads it, try again next pass
+		if (!Endpoint_IsINReady()) {
+			return;
+		}
+
+		u8 tail = (head - count) & RING_MASK;
+		u8 n		= group_len(tail);
+
+		if ((Endpoint_BytesInEndpoint() + (n * PKT_SIZE)) > ep_size) {
+			Endpoint_ClearIN();
+			continue;
+		}
+
+		for (u8 i = 0; i < n; i++) {
+			const MIDI_EventPacket_t* p = &ring[(tail + i) & RING_MASK];
+			Endpoint_Write_8(p->Event);
+			Endpoint_Write_8(p->Data1);
+			Endpoint_Write_8(p->Data2);
+			Endpoint_Write_8(p->Data3);
+		}
+
+		count -= n;
+		stats.sent += n;
+		latency_record(LATENCY_INPUT_TO_USB, ring_stamp[tail]);
+	}
+
+	// Send whatever this pass collected
+	if (Endpoint_IsINReady() && Endpoint_BytesInEndpoint()) {
+		Endpoint_ClearIN();
+	}
+}
+
+u8 midi_tx_free(void) {
+	return MIDI_TX_RING_SIZE - count;
+}
+
+void midi_tx_get_stats(struct midi_tx_stats* s) {
+	*s = stats;
+}
+
+void midi_tx_reset_stats(void) {
+	memset(&stats, 0, sizeof(stats));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Number of packets in the group starting at idx
+static u8 group_len(u8 idx) {
+	u8 n = 1;
+
+	while (ring_bit(ring_more, idx)) {
+		idx = (idx + 1) & RING_MASK;
+		n++;
+	}
+
+	return n;
+}
+
+static void drop_oldest(void) {
+	u8 tail = (head - count) & RING_MASK;
+	u8 n		= group_len(tail);
+	u8 channel;
+	u8 lost = group_nrpn(tail, n, &channel) & (NRPN_PARAM | NRPN_MSB);
+
+	for (u8 i = 0; i < n; i++) {
+		drop_observe(&ring[(tail + i) & RING_MASK]);
+	}
+
+	count -= n;
+	stats.dropped_oldest += n;
+
+	if (lost) {
+		drop_dependents(channel, lost);
+	}
+}
+
+/*
+	A group that selects a parameter or sets the Data Entry MSB is the context
+	of the Data Entry groups queued after it on the same channel. Once it is
+	dropped they would apply to the wrong parameter or MSB, so they are dropped
+	too, up to the next group that sets the lost context again. The ring is
+	compacted in place, kept groups stay in order.
+*/
+static void drop_dependents(u8 channel, u8 lost) {
+	u8	 rd			= (head - count) & RING_MASK;
+	u8	 wr			= rd;
+	u8	 left		= count;
+	u8	 kept		= 0;
+	bool active = true;
+
+	while (left > 0) {
+		u8	 len = group_len(rd);
+		u8	 ch;
+		u8	 nrpn = active ? group_nrpn(rd, len, &ch) : 0;
+		bool drop = false;
+
+		if (nrpn && ch == channel) {
+			if ((nrpn & NRPN_PARAM) || (lost == NRPN_MSB && (nrpn & NRPN_MSB))) {
+				active = false;
+			} else {
+				drop = (nrpn & NRPN_DATA) != 0;
+			}
+		}
+
+		if (drop) {
+			for (u8 i = 0; i < len; i++) {
+				drop_observe(&ring[(rd + i) & RING_MASK]);
+			}
+			stats.dropped_oldest += len;
+		} else {
+			if (wr != rd) {
+				for (u8 i = 0; i < len; i++) {
+					u8 from = (rd + i) & RING_MASK;
+					u8 to		= (wr + i) & RING_MASK;
+
+					ring[to] = ring[from];
+					ring_bit_set(ring_more, to, ring_bit(ring_more, from));
+				}
+				ring_bit_set(ring_fixed, wr, ring_bit(ring_fixed, rd));
+				ring_stamp[wr] = ring_stamp[rd];
+			}
+			wr = (wr + len) & RING_MASK;
+			kept += len;
+		}
+
+		rd = (rd + len) & RING_MASK;
+		left -= len;
+	}
+
+	head	= wr;
+	count = kept;
+}
+
+// The NRPN state of its channel that a group of CCs sets or depends on
+static u8 group_nrpn(u8 idx, u8 len, u8* channel) {
+	u8 nrpn = 0;
+
+	for (u8 i = 0; i < len; i++) {
+		const MIDI_EventPacket_t* p = &ring[(idx + i) & RING_MASK];
+
+		if ((p->Event & 0x0F) != CIN_CC) {
+			return 0;
+		}
+
+		*channel = p->Data1 & 0x0F;
+
+		switch (p->Data2) {
+			case MIDI_CC_NONREG_PARM_NUM_MSB:
+			case MIDI_CC_NONREG_PARM_NUM_LSB:
+			case MIDI_CC_REGIST_PARM_NUM_MSB:
+			case MIDI_CC_REGIST_PARM_NUM_LSB: nrpn |= NRPN_PARAM; break;
+			case MIDI_CC_MSB_DATA_ENTRY: nrpn |= NRPN_MSB | NRPN_DATA; break;
+			case MIDI_CC_LSB_DATA_ENTRY:
+			case MIDI_CC_DATA_INCREMENT:
+			case MIDI_CC_DATA_DECREMENT: nrpn |= NRPN_DATA; break;
+			default: break;
+		}
+	}
+
+	return nrpn;
+}
+
+/*
+	The receiver never sees a dropped packet. If it selected a parameter or set
+	the Data Entry MSB the NRPN cache is wrong, so the next NRPN message is sent
+	in full.
+*/
+static void drop_observe(const MIDI_EventPacket_t* pkt) {
+	if ((pkt->Event & 0x0F) != CIN_CC) {
+		return;
+	}
+
+	midi_cc_event_s cc = {
+			.channel = pkt->Data1 & 0x0F,
+			.control = pkt->Data2,
+			.value	 = pkt->Data3,
+	};
+	midi_nrpn_observe(&cc);
+}
+
+/*
+	Overwrite the newest queued group that has the same packets apart from the
+	values (the last data byte of each packet). Parameter and Data Entry
+	controllers depend on what was sent before them and are never merged. The
+	queued group keeps its latency tag, so the wait is measured from the oldest
+	input it carries.
+*/
+static bool coalesce(const MIDI_EventPacket_t* pkt, u8 n) {
+	if (!can_coalesce(pkt)) {
+		return false;
+	}
+
+	u8 idx	 = (head - count) & RING_MASK;
+	u8 match = 0xFF;
+
+	for (u8 left = count; left > 0;) {
+		u8 len = group_len(idx);
+		u8 i	 = 0;
+
+		if (len == n && !ring_bit(ring_fixed, idx)) {
+			for (; i < n; i++) {
+				const MIDI_EventPacket_t* q = &ring[(idx + i) & RING_MASK];
+				if (q->Event != pkt[i].Event || q->Data1 != pkt[i].Data1 ||
+						q->Data2 != pkt[i].Data2) {
+					break;
+				}
+			}
+		}
+
+		if (i == n) {
+			match = idx;
+		}
+
+		idx = (idx + len) & RING_MASK;
+		left -= len;
+	}
+
+	if (match == 0xFF) {
+		return false;
+	}
+
+	for (u8 i = 0; i < n; i++) {
+		ring[(match + i) & RING_MASK].Data3 = pkt[i].Data3;
+	}
+
+	return true;
+}
+
+static bool can_coalesce(const MIDI_EventPacket_t* pkt) {
+	if ((pkt->Event & 0x0F) != CIN_CC) {
+		return false;
+	}
+
+	switch (pkt->Data2) {
+		case MIDI_CC_MSB_DATA_ENTRY:
+		case MIDI_CC_LSB_DATA_ENTRY:
+		case MIDI_CC_DATA_INCREMENT:
+		case MIDI_CC_DATA_DECREMENT:
+		case MIDI_CC_NONREG_PARM_NUM_LSB:
+		case MIDI_CC_NONREG_PARM_NUM_MSB:
+		case MIDI_CC_REGIST_PARM_NUM_LSB:
+		case MIDI_CC_REGIST_PARM_NUM_MSB: return false;
+		default: return true;
+	}
+}
+
+static bool ring_bit(const u8* bits, u8 idx) {
+	return bits[idx / 8] & (1 << (idx % 8));
+}
+
+static void ring_bit_set(u8* bits, u8 idx, bool set) {
+	if (set) {
+		bits[idx / 8] |= (1 << (idx % 8));
+	} else {
+		bits[idx / 8] &= ~(1 << (idx % 8));
+	}
+}
@@ -0,0 +1,122 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <string.h>
+
+#include "system/latency.h"
+#include "system/hardware.h"
+#include "system/time.h"
+#include "system/utility.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define TAG_SHIFT (4) // log2(LATENCY_TAG_US)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+STATIC_ASSERT((1 << TAG_SHIFT) == LATENCY_TAG_US,
+							"TAG_SHIFT does not match LATENCY_TAG_US");
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static u8 bin_of(u16 t);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static struct latency_stats stats[LATENCY_PATH_NB];
+static u16									led_pending[NUM_ENCODERS];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+u16 latency_tag(u32 now_us) {
+	u16 tag = (u16)(now_us >> TAG_SHIFT);
+	return (tag == LATENCY_TAG_NONE) ? 1 : tag;
+}
+
+void latency_record(enum latency_path path, u16 tag) {
+	if (tag == LATENCY_TAG_NONE || path >= LATENCY_PATH_NB) {
+		return;
+	}
+
+	struct latency_stats* s = &stats[path];
+	u16										t = (u16)(latency_tag(systime_us()) - tag);
+
+	// Keep the mean exact until the sum could overflow, then stop counting
+	if (s->count == UINT16_MAX) {
+		return;
+	}
+
+	s->min = (s->count == 0) ? t : MIN(s->min, t);
+	s->max = MAX(s->max, t);
+	s->sum += t;
+	s->count++;
+
+	u16* bin = &s->bins[bin_of(t)];
+	if (*bin < UINT16_MAX) {
+		(*bin)++;
+	}
+}
+
+void latency_led_pending(u8 enc_idx, u16 tag) {
+	if (enc_idx < NUM_ENCODERS && led_pending[enc_idx] == LATENCY_TAG_NONE) {
+		led_pending[enc_idx] = tag;
+	}
+}
+
+void latency_led_drawn(u8 enc_idx) {
+	if (enc_idx < NUM_ENCODERS && led_pending[enc_idx] != LATENCY_TAG_NONE) {
+		latency_record(LATENCY_USB_TO_LED, led_pending[enc_idx]);
+		led_pending[enc_idx] = LATENCY_TAG_NONE;
+	}
+}
+
+void latency_get(enum latency_path path, struct latency_stats* s) {
+	if (path < LATENCY_PATH_NB) {
+		*s = stats[path];
+	} else {
+		memset(s, 0, sizeof(*s));
+	}
+}
+
+u16 latency_percentile(const struct latency_stats* s, u8 pct) {
+	u32 want = ((u32)s->count * pct + 99) / 100;
+	u32 seen = 0;
+
+	if (want == 0) {
+		return 0;
+	}
+
+	for (u8 b = 0; b < LATENCY_BINS - 1; b++) {
+		seen += s->bins[b];
+		if (seen >= want) {
+			return MIN((u16)((2U << b) - 1), s->max);
+		}
+	}
+
+	return s->max;
+}
+
+void latency_reset(void) {
+	memset(stats, 0, sizeof(stats));
+	memset(led_pending, 0, sizeof(led_pending));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Histogram bin of a time, the position of its highest set bit
+static u8 bin_of(u16 t) {
+	u8 b = 0;
+
+	while ((t >>= 1) != 0 && b < LATENCY_BINS - 1) {
+		b++;
+	}
+
+	return b;
+}
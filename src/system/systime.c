@@ -7,6 +7,7 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #include "system/time.h"
 #include "system/print.h"
@@ -16,6 +17,9 @@
 
 #define DIV_ROUND(a, b) (((a) + (b) / 2) / (b))
 
+#define TICKS_PER_MS		DIV_ROUND(F_CPU, 1000)
+#define TICKS_PER_US		DIV_ROUND(F_CPU, 1000000)
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -36,7 +40,7 @@ static volatile u32 thetime = 0;
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void systime_start(void) {
-	TCE0.PER			= DIV_ROUND(F_CPU, 1000);
+	TCE0.PER			= TICKS_PER_MS;
 	TCE0.CTRLB		= TC_WGMODE_NORMAL_gc;
 	TCE0.INTCTRLA = TC_OVFINTLVL_LO_gc;
 	TCE0.CNT			= 0;
@@ -47,6 +51,25 @@ u32 systime_ms(void) {
 	return thetime;
 }
 
+u32 systime_us(void) {
+	u32 ms;
+	u16 cnt;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ms	= thetime;
+		cnt = TCE0.CNT;
+
+		// The counter may have wrapped after interrupts were disabled, in which
+		// case the millisecond count is one behind.
+		if (TCE0.INTFLAGS & TC0_OVFIF_bm) {
+			ms += 1;
+			cnt = TCE0.CNT;
+		}
+	}
+
+	return (ms * 1000) + (cnt / TICKS_PER_US);
+}
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 ISR(TCE0_OVF_vect) {
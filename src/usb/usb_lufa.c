@@ -7,8 +7,12 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #include <avr/pgmspace.h>
+#include <util/atomic.h>
 
 #include "system/types.h"
+#include "system/config.h"
+#include "system/hardware.h"
+#include "system/utility.h"
 #include "usb/usb.h"
 #include "usb/usb_lufa.h"
 #include "system/print.h"
@@ -30,7 +34,6 @@
 #define USB_USB_MIDI_STREAM_EPSIZE	64
 #define USB_CDC_NOTIFICATION_EPSIZE 8
 #define USB_CDC_EPSIZE							16
-#define USB_MIDI_POLLING_INTERVAL		0x05
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -41,6 +44,11 @@ extern USB_ClassInfo_CDC_Device_t lufa_usb_cdc_device;
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+STATIC_ASSERT(USB_MIDI_POLLING_INTERVAL >= 1 && USB_MIDI_POLLING_INTERVAL <= 255,
+							"USB_MIDI_POLLING_INTERVAL must be 1 to 255 ms");
+STATIC_ASSERT(USB_EP_BANKS == 1 || USB_EP_BANKS == 2,
+							"USB_EP_BANKS must be 1 or 2");
+
 enum usb_desc_str {
 	DESC_STR_LANG = 0,
 	DESC_STR_MF		= 1,
@@ -122,13 +130,13 @@ USB_ClassInfo_CDC_Device_t lufa_usb_cdc_device = {
 								{
 										.Address = (CDC_IN_EPNUM | ENDPOINT_DIR_IN),
 										.Size		 = USB_CDC_EPSIZE,
-										.Banks	 = 1,
+										.Banks	 = USB_EP_BANKS,
 								},
 						.DataOUTEndpoint =
 								{
 										.Address = (CDC_OUT_EPNUM | ENDPOINT_DIR_OUT),
 										.Size		 = USB_CDC_EPSIZE,
-										.Banks	 = 1,
+										.Banks	 = USB_EP_BANKS,
 								},
 						.NotificationEndpoint =
 								{
@@ -451,9 +459,14 @@ PROGMEM static const struct usb_descriptor desc_cfg = {
 };
 
 #pragma GCC diagnostic ignored "-Wunused-variable"
-static bool vser_active = false;
+static volatile bool vser_active = false; // Set by the USB interrupt
 #pragma GCC diagnostic pop
 
+static volatile u8		sof_count;
+static volatile bool config_pending; // Set by the USB interrupt
+static u8						 session; // Configurations selected by the host (wraps)
+static bool					 sof_enabled;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int usb_init(void) {
@@ -461,25 +474,77 @@ int usb_init(void) {
 	return 0;
 }
 
+/*
+	Control requests are serviced by the USB interrupt (see
+	INTERRUPT_CONTROL_ENDPOINT) so enumeration does not wait for the main loop,
+	and USB_USBTask() is not needed. The interrupt only sets single byte
+	variables (config_pending, sof_count, vser_active) that the main loop polls,
+	it never touches the event queues.
+
+	The main loop selects and writes the data endpoints without masking the
+	interrupt, so the interrupt must not configure them. LUFA restores the
+	selected endpoint after servicing the control endpoint, but configuring an
+	endpoint resets its buffer under a write in progress. A new configuration is
+	applied here instead, and usb_configured() is false until it has been.
+*/
 int usb_update(void) {
-	// The USB packets are periodically transmitted by LUFA, calling the
-	// MIDI_Device_USBTask function flushes the packets immediately to the
-	// host.)
-	MIDI_Device_USBTask(&lufa_usb_midi_device);
+	if (config_pending) {
+		config_pending = false;
+
+		MIDI_Device_ConfigureEndpoints(&lufa_usb_midi_device);
+		session++;
+
+#ifdef HID_ENABLE
+		ConfigSuccess &=
+				Endpoint_ConfigureEndpoint((SHARED_IN_EPNUM | ENDPOINT_DIR_IN),
+																	 EP_TYPE_INTERRUPT, SHARED_EPSIZE, 1);
+#endif
+
+#ifdef ENABLE_CONSOLE
+		CDC_Device_ConfigureEndpoints(&lufa_usb_cdc_device);
+#endif
+	}
+
+	// MIDI out is sent by midi_update(), MIDI_Device_USBTask() is not used as
+	// its flush blocks until the host reads the endpoint.
 
 #ifdef ENABLE_CONSOLE
 	// Throw away unused received bytes from host
-	if (vser_active) {
+	if (vser_active && usb_configured()) {
 		// while (CDC_Device_ReceiveByte(&lufa_usb_cdc_device) == true) {}
 		CDC_Device_USBTask(&lufa_usb_cdc_device);
 	}
 
 #endif
 
-	USB_USBTask(); // LUFA usb stack update
+	// The SOF interrupt runs at 1kHz, only enable it while it is used
+	if (gCONFIG.midi_tx_sof != sof_enabled) {
+		sof_enabled = gCONFIG.midi_tx_sof;
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (sof_enabled) {
+				USB_Device_EnableSOFEvents();
+			} else {
+				USB_Device_DisableSOFEvents();
+			}
+		}
+	}
+
 	return 0;
 }
 
+u8 usb_sof_count(void) {
+	return sof_count;
+}
+
+u8 usb_session(void) {
+	return session;
+}
+
+bool usb_configured(void) {
+	return USB_DeviceState == DEVICE_STATE_Configured && !config_pending;
+}
+
 /** This function is called by the library when in device mode, and must be
  * overridden (see library "USB Descriptors" documentation) by the application
  * code so that the address and size of a requested descriptor can be given to
@@ -572,18 +637,15 @@ void EVENT_USB_Device_Connect(void) {
 void EVENT_USB_Device_Disconnect(void) {
 }
 
-// Callback for USB device configuration changed
+// Callback for USB device configuration changed, called from the interrupt.
+// The endpoints are configured by usb_update().
 void EVENT_USB_Device_ConfigurationChanged(void) {
-	MIDI_Device_ConfigureEndpoints(&lufa_usb_midi_device);
-
-#ifdef HID_ENABLE
-	ConfigSuccess &= Endpoint_ConfigureEndpoint(
-			(SHARED_IN_EPNUM | ENDPOINT_DIR_IN), EP_TYPE_INTERRUPT, SHARED_EPSIZE, 1);
-#endif
+	config_pending = true;
+}
 
-#ifdef ENABLE_CONSOLE
-	CDC_Device_ConfigureEndpoints(&lufa_usb_cdc_device);
-#endif
+// Called from the USB interrupt at the start of every frame
+void EVENT_USB_Device_StartOfFrame(void) {
+	sof_count++;
 }
 
 void EVENT_USB_Device_ControlRequest(void) {
@@ -613,13 +675,13 @@ void EVENT_CDC_Device_ControLineStateChanged(
 
 // Function to check if the virtual serial port is active (DTR asserted)
 bool usb_cdc_is_active(void) {
-	return vser_active;
+	return vser_active && usb_configured();
 }
 
 void println_progmem(const char* const str) {
 	assert(str);
 
-	if (vser_active) {
+	if (vser_active && usb_configured()) {
 		CDC_Device_SendString_P(&lufa_usb_cdc_device, str);
 		CDC_Device_SendString_P(&lufa_usb_cdc_device, PSTR("\r\n"));
 		CDC_Device_Flush(&lufa_usb_cdc_device);
@@ -629,7 +691,7 @@ void println_progmem(const char* const str) {
 void println(const char* const str) {
 	assert(str);
 
-	if (vser_active) {
+	if (vser_active && usb_configured()) {
 		CDC_Device_SendString(&lufa_usb_cdc_device, str);
 		CDC_Device_SendString_P(&lufa_usb_cdc_device, PSTR("\r\n"));
 		CDC_Device_Flush(&lufa_usb_cdc_device);
@@ -639,7 +701,7 @@ void println(const char* const str) {
 void printbuf(u8* buf, uint len) {
 	assert(buf);
 
-	if (vser_active) {
+	if (vser_active && usb_configured()) {
 		CDC_Device_SendData(&lufa_usb_cdc_device, buf, len);
 		CDC_Device_SendString_P(&lufa_usb_cdc_device, PSTR("\r\n"));
 		CDC_Device_Flush(&lufa_usb_cdc_device);
@@ -0,0 +1,86 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <avr/pgmspace.h>
+
+#include "virtmap/curve.h"
+#include "system/error.h"
+#include "system/utility.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define NUM_BUILTIN_CURVES (VMAP_CURVE_USER_0 - VMAP_CURVE_LOG)
+#define SEG_MASK					 ((1 << VMAP_CURVE_SEG_BITS) - 1)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+STATIC_ASSERT(VMAP_CURVE_USER_NB == VMAP_CURVE_NB - VMAP_CURVE_USER_0,
+							"User curve count does not match enum vmap_curve");
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+u16 gVMAP_USER_CURVES[VMAP_CURVE_USER_NB][VMAP_CURVE_POINTS];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+	Generated offline with k = 4:
+		log: ln(1 + (e^k - 1) * t) / k
+		exp: (e^(k * t) - 1) / (e^k - 1)
+		s:	 t^2 * (3 - 2 * t)
+*/
+// clang-format off
+static const u16 builtin_curves[NUM_BUILTIN_CURVES][VMAP_CURVE_POINTS] PROGMEM = {
+	[VMAP_CURVE_LOG - VMAP_CURVE_LOG] = {0, 24087, 33442, 39360, 43699, 47125, 49958, 52372, 54476, 56340, 58014, 59532, 60921, 62202, 63390, 64498, 65535},
+	[VMAP_CURVE_EXP - VMAP_CURVE_LOG] = {0, 347, 793, 1366, 2101, 3045, 4257, 5814, 7812, 10378, 13673, 17904, 23336, 30311, 39268, 50768, 65535},
+	[VMAP_CURVE_S - VMAP_CURVE_LOG]		= {0, 736, 2816, 6048, 10240, 15200, 20736, 26656, 32768, 38879, 44799, 50335, 55295, 59487, 62719, 64799, 65535},
+};
+// clang-format on
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void vmap_curve_init(void) {
+	for (u8 c = 0; c < VMAP_CURVE_USER_NB; c++) {
+		for (u8 p = 0; p < VMAP_CURVE_POINTS; p++) {
+			gVMAP_USER_CURVES[c][p] =
+					(u16)MIN((u32)p << VMAP_CURVE_SEG_BITS, (u32)UINT16_MAX);
+		}
+	}
+}
+
+u16 vmap_curve_eval(u8 curve, u16 t) {
+	// The last segment ends at 0x10000, snap the endpoint to the last point
+	u8	idx	 = (t == UINT16_MAX) ? VMAP_CURVE_POINTS - 2 : t >> VMAP_CURVE_SEG_BITS;
+	u16 frac = (t == UINT16_MAX) ? (1 << VMAP_CURVE_SEG_BITS) : t & SEG_MASK;
+	u16 a, b;
+
+	if (curve >= VMAP_CURVE_USER_0) {
+		const u16* pts = gVMAP_USER_CURVES[curve - VMAP_CURVE_USER_0];
+		a							 = pts[idx];
+		b							 = pts[idx + 1];
+	} else {
+		const u16* pts = builtin_curves[curve - VMAP_CURVE_LOG];
+		a							 = pgm_read_word(&pts[idx]);
+		b							 = pgm_read_word(&pts[idx + 1]);
+	}
+
+	return (u16)(a + (((i32)b - a) * frac >> VMAP_CURVE_SEG_BITS));
+}
+
+int vmap_curve_set_point(u8 user, u8 point, u16 value) {
+	if (user >= VMAP_CURVE_USER_NB || point >= VMAP_CURVE_POINTS) {
+		return ERR_BAD_PARAM;
+	}
+
+	gVMAP_USER_CURVES[user][point] = value;
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -0,0 +1,130 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	Hash table of singly linked id chains, one chain per bucket. The links are
+	stored in a flat array indexed by vmap id so the whole index costs
+	VMAP_INDEX_BUCKETS + VMAP_POOL_SIZE bytes of RAM.
+
+	Removing an id searches the chains for its predecessor - this only happens
+	when a vmap configuration is changed, never on the MIDI input path.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <string.h>
+
+#include "virtmap/index.h"
+#include "system/error.h"
+#include "system/utility.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define BUCKET(ch, cc) (((cc) ^ ((ch) << 3)) & (VMAP_INDEX_BUCKETS - 1))
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+STATIC_ASSERT((VMAP_INDEX_BUCKETS & (VMAP_INDEX_BUCKETS - 1)) == 0,
+							"VMAP_INDEX_BUCKETS must be a power of 2");
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static u8		vmap_key(const struct virtmap* vmap);
+static bool vmap_matches(u8 id, u8 channel, u8 cc);
+static void index_insert(u8 id);
+static void index_remove(u8 id);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static u8 buckets[VMAP_INDEX_BUCKETS]; // Head id of each chain
+static u8 links[VMAP_POOL_SIZE];			 // Next id in the chain
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void vmap_index_build(void) {
+	memset(buckets, VMAP_ID_NONE, sizeof(buckets));
+	memset(links, VMAP_ID_NONE, sizeof(links));
+
+	// Insert in reverse so that each chain is walked in vmap order
+	for (u8 id = VMAP_POOL_SIZE; id-- > 0;) {
+		index_insert(id);
+	}
+}
+
+int vmap_index_update(u8 id) {
+	if (id >= VMAP_POOL_SIZE) {
+		return ERR_BAD_PARAM;
+	}
+
+	index_remove(id);
+	index_insert(id);
+	return 0;
+}
+
+u8 vmap_index_find(u8 channel, u8 cc) {
+	u8 id = buckets[BUCKET(channel, cc)];
+	while (id != VMAP_ID_NONE && !vmap_matches(id, channel, cc)) {
+		id = links[id];
+	}
+	return id;
+}
+
+u8 vmap_index_next(u8 id, u8 channel, u8 cc) {
+	if (id >= VMAP_POOL_SIZE) {
+		return VMAP_ID_NONE;
+	}
+
+	do {
+		id = links[id];
+	} while (id != VMAP_ID_NONE && !vmap_matches(id, channel, cc));
+	return id;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool vmap_matches(u8 id, u8 channel, u8 cc) {
+	const struct virtmap* vmap = &gVMAP_POOL[id];
+	return vmap->cfg.type == PROTOCOL_MIDI && vmap->cfg.midi.channel == channel &&
+				 vmap_key(vmap) == cc;
+}
+
+// Pitch bend has no controller number, it is indexed as CC 0
+static u8 vmap_key(const struct virtmap* vmap) {
+	if (vmap->cfg.midi.mode == MIDI_MODE_PITCH_BEND) {
+		return 0;
+	}
+	return vmap->cfg.midi.cc;
+}
+
+static void index_insert(u8 id) {
+	const struct virtmap* vmap = vmap_from_id(id, NULL);
+
+	// Only allocated MIDI vmaps can be driven by incoming MIDI
+	if (vmap == NULL || vmap->cfg.type != PROTOCOL_MIDI) {
+		links[id] = VMAP_ID_NONE;
+		return;
+	}
+
+	u8 b			 = BUCKET(vmap->cfg.midi.channel, vmap_key(vmap));
+	links[id]	 = buckets[b];
+	buckets[b] = id;
+}
+
+static void index_remove(u8 id) {
+	// The old configuration is gone, so search every chain for the id.
+	for (u8 b = 0; b < VMAP_INDEX_BUCKETS; b++) {
+		u8* prev = &buckets[b];
+		while (*prev != VMAP_ID_NONE) {
+			if (*prev == id) {
+				*prev			= links[id];
+				links[id] = VMAP_ID_NONE;
+				return;
+			}
+			prev = &links[*prev];
+		}
+	}
+}
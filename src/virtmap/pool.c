@@ -0,0 +1,169 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <string.h>
+
+#include "virtmap/pool.h"
+#include "virtmap/index.h"
+#include "led/color.h"
+#include "system/error.h"
+#include "system/utility.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define NUM_POOL_ENCODERS (NUM_ENC_BANKS * NUM_ENCODERS)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+STATIC_ASSERT(VMAP_POOL_SIZE < VMAP_ID_NONE, "Too many vmaps for u8 ids");
+STATIC_ASSERT(VMAP_MAX_PER_ENC <= 8, "vmap_active is stored in 3 bits");
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static struct encoder* encoder_at(u8 i);
+static u8							 pool_used(void);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct virtmap gVMAP_POOL[VMAP_POOL_SIZE];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void vmap_pool_init(void) {
+	for (u8 i = 0; i < NUM_POOL_ENCODERS; i++) {
+		encoder_at(i)->vmap_count = NUM_VMAPS_PER_ENC;
+	}
+
+	vmap_pool_layout();
+
+	for (u8 id = 0; id < VMAP_POOL_SIZE; id++) {
+		vmap_reset(&gVMAP_POOL[id]);
+	}
+}
+
+int vmap_pool_layout(void) {
+	u8 base = 0;
+
+	for (u8 i = 0; i < NUM_POOL_ENCODERS; i++) {
+		struct encoder* enc = encoder_at(i);
+
+		if (enc->vmap_count > VMAP_MAX_PER_ENC ||
+				enc->vmap_count > VMAP_POOL_SIZE - base) {
+			return ERR_NO_MEM;
+		}
+
+		enc->vmap_base = base;
+		base += enc->vmap_count;
+
+		if (enc->vmap_active >= enc->vmap_count) {
+			enc->vmap_active = 0;
+		}
+	}
+
+	return 0;
+}
+
+int vmap_pool_resize(struct encoder* enc, u8 count) {
+	if (count > VMAP_MAX_PER_ENC) {
+		return ERR_BAD_PARAM;
+	}
+
+	u8 used = pool_used();
+	u8 old	= enc->vmap_count;
+
+	if (count > old && count - old > VMAP_POOL_SIZE - used) {
+		return ERR_NO_MEM;
+	}
+
+	// Shift the slices of all following encoders
+	u8 old_end = enc->vmap_base + old;
+	u8 new_end = enc->vmap_base + count;
+	memmove(&gVMAP_POOL[new_end], &gVMAP_POOL[old_end],
+					(used - old_end) * sizeof(struct virtmap));
+
+	for (u8 id = old_end; id < new_end; id++) {
+		vmap_reset(&gVMAP_POOL[id]);
+	}
+
+	enc->vmap_count = count;
+	vmap_pool_layout();
+
+	// Ids have moved
+	vmap_index_build();
+	return 0;
+}
+
+u8 vmap_pool_free(void) {
+	return VMAP_POOL_SIZE - pool_used();
+}
+
+void vmap_reset(struct virtmap* vmap) {
+	memset(vmap, 0, sizeof(struct virtmap));
+	vmap->position.start = ENC_MIN;
+	vmap->position.stop	 = ENC_MAX;
+	vmap->range.lower		 = MIDI_CC_MIN;
+	vmap->range.upper		 = MIDI_CC_MAX;
+	vmap->cfg.type			 = PROTOCOL_NONE;
+	vmap->curve					 = VMAP_CURVE_LINEAR;
+	vmap->hsv.saturation = 255;
+	vmap->hsv.value			 = 255;
+	color_update_vmap_rgb(vmap);
+	vmap_compile(vmap);
+}
+
+u8 vmap_id(u8 bank, u8 enc, u8 vmap) {
+	if (bank >= NUM_ENC_BANKS || enc >= NUM_ENCODERS) {
+		return VMAP_ID_NONE;
+	}
+
+	const struct encoder* owner = &gENCODERS[bank][enc];
+	if (vmap >= owner->vmap_count) {
+		return VMAP_ID_NONE;
+	}
+
+	return owner->vmap_base + vmap;
+}
+
+struct virtmap* vmap_from_id(u8 id, struct encoder** enc) {
+	// The owner is the last encoder whose slice starts at or before the id
+	u8 lo = 0;
+	u8 hi = NUM_POOL_ENCODERS;
+	while (hi - lo > 1) {
+		u8 mid = (lo + hi) / 2;
+		if (encoder_at(mid)->vmap_base <= id) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	struct encoder* owner = encoder_at(lo);
+	if (id < owner->vmap_base || id >= owner->vmap_base + owner->vmap_count) {
+		return NULL;
+	}
+
+	if (enc) {
+		*enc = owner;
+	}
+
+	return &gVMAP_POOL[id];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Encoders in pool order (bank major)
+static struct encoder* encoder_at(u8 i) {
+	return &gENCODERS[0][0] + i;
+}
+
+static u8 pool_used(void) {
+	const struct encoder* last = encoder_at(NUM_POOL_ENCODERS - 1);
+	return last->vmap_base + last->vmap_count;
+}
@@ -0,0 +1,90 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "virtmap/snapshot.h"
+#include "virtmap/pool.h"
+#include "event/event.h"
+#include "midi/nrpn.h"
+#include "midi/tx_ring.h"
+#include "system/error.h"
+#include "system/latency.h"
+#include "system/utility.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define SNAPSHOT_BATCH (4) // Vmaps sent per update
+
+// Free MIDI out entries required before sending a vmap, each vmap uses one
+// and the rest are left for live movement.
+#define SNAPSHOT_QUEUE_RESERVE (8)
+
+// Free transmit ring packets required before sending a batch. The queue is
+// emptied into the ring on every pass, so a slow host only shows up here.
+#define SNAPSHOT_RING_RESERVE (8)
+#define SNAPSHOT_RING_NEEDED                                                   \
+	(SNAPSHOT_RING_RESERVE + (SNAPSHOT_BATCH * MIDI_NRPN_MAX_CC))
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+STATIC_ASSERT(SNAPSHOT_RING_NEEDED <= MIDI_TX_RING_SIZE,
+							"A snapshot batch must fit in the transmit ring");
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Pool ids still to send, the snapshot is idle when next == end
+static u8 next;
+static u8 end;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int vmap_snapshot_start(u8 bank) {
+	if (bank == VMAP_SNAPSHOT_ALL_BANKS) {
+		next = 0;
+		end	 = VMAP_POOL_SIZE - vmap_pool_free();
+		return 0;
+	}
+
+	if (bank >= NUM_ENC_BANKS) {
+		return ERR_BAD_PARAM;
+	}
+
+	// Each bank is a contiguous slice of the pool
+	const struct encoder* first = &gENCODERS[bank][0];
+	const struct encoder* last	= &gENCODERS[bank][NUM_ENCODERS - 1];
+
+	next = first->vmap_base;
+	end	 = last->vmap_base + last->vmap_count;
+	return 0;
+}
+
+void vmap_snapshot_update(void) {
+	// The pool may have been resized since the snapshot started
+	end = MIN(end, VMAP_POOL_SIZE - vmap_pool_free());
+
+	// Wait for the host to read what is queued, live movement must not be lost
+	if (next < end && midi_tx_free() < SNAPSHOT_RING_NEEDED) {
+		return;
+	}
+
+	for (u8 sent = 0; sent < SNAPSHOT_BATCH && next < end;) {
+		if (event_queue_free(EVENT_CHANNEL_MIDI_OUT) < SNAPSHOT_QUEUE_RESERVE) {
+			return;
+		}
+
+		const struct virtmap* vmap = &gVMAP_POOL[next++];
+
+		// Relative vmaps have no absolute value to send
+		if (vmap->plan.kind == VMAP_PLAN_CC ||
+				vmap->plan.kind == VMAP_PLAN_CC_14) {
+			vmap_send(vmap, LATENCY_TAG_NONE);
+			sent++;
+		}
+	}
+}
@@ -0,0 +1,204 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	Compiles the range/position/protocol configuration of a vmap into a plan
+	that vmap_plan_value() evaluates with one multiply and one shift.
+
+	The reciprocal of the position span is normalised into a 16-bit scale and
+	rounded up, which reproduces the truncating division of convert_range_i16()
+	exactly for 7-bit outputs. For 14-bit outputs the endpoints are exact and
+	intermediate values may be 1 LSB higher than a true division.
+
+	Vmaps with a response curve get a plan that normalises the position to
+	0-0xFFFF instead, the output range is applied after the curve lookup.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "virtmap/virtmap.h"
+#include "event/event.h"
+#include "event/midi.h"
+#include "system/utility.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define PLAN_SCALE_MAX (0xFFFF)
+#define PLAN_SHIFT_MAX (31)
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+STATIC_ASSERT(VMAP_PLAN_NB <= 4, "vmap_plan.kind is stored in 2 bits");
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void plan_range(struct vmap_plan* plan, u8 curve, u32 range, u32 span);
+static void plan_scale(struct vmap_plan* plan, u32 range, u32 span);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void vmap_compile(struct virtmap* vmap) {
+	struct vmap_plan* plan		= &vmap->plan;
+	bool							was_rel = (plan->kind == VMAP_PLAN_REL);
+
+	plan->kind	= VMAP_PLAN_NONE;
+	plan->base	= 0;
+	plan->range = 0;
+	plan_scale(plan, 0, 0);
+
+	if (vmap->curve >= VMAP_CURVE_NB) {
+		vmap->curve = VMAP_CURVE_LINEAR;
+	}
+
+	if (vmap->cfg.type != PROTOCOL_MIDI) {
+		return;
+	}
+
+	bool invert = (vmap->range.lower > vmap->range.upper);
+	i16	 lower	= MIN(vmap->range.lower, vmap->range.upper);
+	i16	 upper	= MAX(vmap->range.lower, vmap->range.upper);
+	i16	 span		= (i16)vmap->position.stop - vmap->position.start;
+
+	switch (vmap->cfg.midi.mode) {
+		case MIDI_MODE_CC: {
+			// An inverted range is flipped back around MIDI_CC_MAX, so the output
+			// always counts up from base.
+			plan->kind = VMAP_PLAN_CC;
+			plan->base =
+					invert ? (i16)(MIDI_CC_MAX - vmap->range.lower) : vmap->range.lower;
+			plan_range(plan, vmap->curve, (u32)(upper - lower), (u32)MAX(span, 0));
+			break;
+		}
+
+		case MIDI_MODE_CC_14:
+		case MIDI_MODE_NRPN:
+		case MIDI_MODE_RPN:
+		case MIDI_MODE_PITCH_BEND: {
+			// The 7-bit range selects the MSB range, the LSB spans 0-127 at each end.
+			// An inverted range is flipped around 0x3FFF as in the 7-bit case.
+			i16 lower14 = (i16)(lower << 7);
+			i16 upper14 = (i16)((upper << 7) | 0x7F);
+			plan->kind	= VMAP_PLAN_CC_14;
+			plan->base	= invert ? (i16)(0x3FFF - upper14) : lower14;
+			plan_range(plan, vmap->curve, (u32)(upper14 - lower14),
+								 (u32)MAX(span, 0) << VMAP_POS_FRAC_BITS);
+			break;
+		}
+
+		case MIDI_MODE_REL_CC:
+		case MIDI_MODE_REL_CC_OFFSET:
+		case MIDI_MODE_REL_CC_SIGN_MAG: {
+			// Nothing to scale. A vmap that was already relative keeps the delta
+			// that vmap_rel_flush() may be holding, otherwise there is none.
+			plan->kind = VMAP_PLAN_REL;
+			if (!was_rel) {
+				vmap->curr_val = 0;
+			}
+			break;
+		}
+
+		default: break;
+	}
+
+	// Cache the value of the current position for vmap_send()
+	if ((plan->kind == VMAP_PLAN_CC || plan->kind == VMAP_PLAN_CC_14) &&
+			vmap->curr_pos >= vmap->position.start &&
+			vmap->curr_pos <= vmap->position.stop) {
+		vmap->curr_val = vmap_plan_value(vmap);
+	}
+}
+
+void vmap_send(const struct virtmap* vmap, u16 stamp) {
+	const struct midi_cfg* cfg = &vmap->cfg.midi;
+	i16										 val = vmap->curr_val;
+	midi_event_s					 midi_evt;
+
+	midi_evt.stamp = stamp;
+
+	switch (vmap->plan.kind) {
+		case VMAP_PLAN_CC: {
+			midi_evt.type						 = MIDI_EVENT_CC;
+			midi_evt.data.cc.channel = cfg->channel;
+			midi_evt.data.cc.control = cfg->cc;
+			midi_evt.data.cc.value	 = val & MIDI_CC_MAX;
+			event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
+			break;
+		}
+
+		case VMAP_PLAN_CC_14: {
+			if (cfg->mode == MIDI_MODE_NRPN || cfg->mode == MIDI_MODE_RPN) {
+				midi_evt.type							 = MIDI_EVENT_NRPN;
+				midi_evt.data.nrpn.channel = cfg->channel;
+				midi_evt.data.nrpn.rpn		 = (cfg->mode == MIDI_MODE_RPN);
+				midi_evt.data.nrpn.param	 = ((u16)cfg->param_msb << 7) | cfg->raw;
+				midi_evt.data.nrpn.value	 = (u16)val;
+				event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
+				break;
+			}
+
+			if (cfg->mode == MIDI_MODE_PITCH_BEND) {
+				midi_evt.type							 = MIDI_EVENT_PITCH_BEND;
+				midi_evt.data.bend.channel = cfg->channel;
+				midi_evt.data.bend.value	 = (u16)val;
+				event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
+				break;
+			}
+
+			// The MSB/LSB pair is one event so that it is sent in one transaction
+			midi_evt.type							 = MIDI_EVENT_CC_14;
+			midi_evt.data.cc14.channel = cfg->channel;
+			midi_evt.data.cc14.control = cfg->cc;
+			midi_evt.data.cc14.value	 = (u16)val;
+			event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
+			break;
+		}
+
+		case VMAP_PLAN_REL:
+		case VMAP_PLAN_NONE:
+		default: break;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Map a span of positions onto an output range, through the curve if set.
+static void plan_range(struct vmap_plan* plan, u8 curve, u32 range, u32 span) {
+	if (curve == VMAP_CURVE_LINEAR) {
+		plan_scale(plan, range, span);
+	} else {
+		plan->range = (u16)range;
+		plan_scale(plan, UINT16_MAX, span);
+
+		// The rounded up scale can take full travel to 0x10000, which the curve
+		// lookup would read as 0. Step it down until the end of the span fits.
+		while (plan->scale > 0 &&
+					 ((span * plan->scale) >> plan->shift) > UINT16_MAX) {
+			plan->scale--;
+		}
+	}
+}
+
+// scale / 2^shift ~= range / span, with the largest shift that keeps scale in
+// 16 bits so that x * scale always fits in 32 bits.
+static void plan_scale(struct vmap_plan* plan, u32 range, u32 span) {
+	if (range == 0 || span == 0) {
+		plan->scale = 0;
+		plan->shift = 0;
+		return;
+	}
+
+	const u32 limit = PLAN_SCALE_MAX * span;
+	u8				shift = 0;
+
+	while (shift < PLAN_SHIFT_MAX && (range << shift) <= (limit >> 1)) {
+		shift++;
+	}
+
+	plan->scale = (u16)(((range << shift) + span - 1) / span);
+	plan->shift = shift;
+}